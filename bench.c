@@ -0,0 +1,619 @@
+// Puzzle box benchmarks, built and run by make bench
+// (c) 2018 Adrian Kennard www.me.uk @TheRealRevK
+// Micro benchmarks of maze generation, test(), slice() and the polyhedron formatter, then macro runs of the makesamples
+// boxes with a fixed seed, as JSON to stdout. The output of each macro run is hashed and checked against bench.golden,
+// so an optimisation can be shown to change nothing, and a --png thumbnail has each chunk's CRC checked. With --render, parts of a fixed corpus are rendered by openscad
+// instead, with each backend it has, to tie render time and memory to what is emitted.
+
+#define main puzzlebox_main
+#include "puzzlebox.c"
+#undef main
+
+#define	BENCH_SEED	"--seed=1"      // Same mazes every run
+#define	BENCH_ARGS	20
+
+typedef struct
+{                               // Macro run, from makesamples
+   const char *name;
+   const char *arg[BENCH_ARGS];
+} bench_box_t;
+
+static const bench_box_t bench_box[] = {
+   {"version", {"--parts=2", "--core-height=100", "--core-diameter=12", "--outer-sides=7", "--text-outset", "--text-slow", "--text-depth=0.8",
+                "--text-end=AK", "--text-side= Test box\\www.me.uk\\@TheRealRevK\\GitHub revk/PuzzleBox\\Thingiverse 2410748",
+                "--text-font=FiveByNineJTD", "--text-font-end=FiveByNineJTD", "--logo", "--text-side-scale=0.85", "--maze-complexity=8"}},
+   {"test-helix-0", {"--base-height=5", "--parts=2", "--core-height=15", "--core-diameter=10", "--text-end=0\\0", "--helix=0", "--logo"}},
+   {"test-helix-1", {"--base-height=5", "--parts=2", "--core-height=15", "--core-diameter=10", "--text-end=1\\1", "--helix=1", "--logo"}},
+   {"test-helix-2", {"--base-height=5", "--parts=2", "--core-height=15", "--core-diameter=10", "--text-end=2\\2", "--helix=2", "--logo"}},
+   {"test-helix-3", {"--base-height=5", "--parts=2", "--core-height=15", "--core-diameter=10", "--text-end=3\\3", "--helix=3", "--logo"}},
+   {"test-hard", {"--parts=3", "--core-height=30", "--core-diameter=10", "--outer-sides=5", "--inside", "--logo"}},
+   {"test-flip", {"--parts=3", "--base-height=5", "--core-height=20", "--core-diameter=10", "--outer-sides=5", "--flip", "--inside", "--logo"}},
+   {"lottery-ticket-hard", {"--parts=2", "--core-height=85", "--core-gap=20", "--core-diameter=10", "--inside", "--outer-sides=4", "--text-slow",
+                            "--text-depth=1", "--text-end= £ ", "--text-side=Good luck\\Prepare to\\be amazed!",
+                            "--text-font=Mountains of Christmas", "--logo"}},
+   {"lottery-ticket-easy", {"--parts=2", "--core-height=85", "--core-gap=20", "--core-diameter=10", "--outer-sides=4", "--text-slow",
+                            "--text-depth=1", "--text-end= £ ", "--text-side=Good luck\\Prepare to\\be amazed!",
+                            "--text-font=Mountains of Christmas", "--logo"}},
+   {"five-pound-coins", {"--parts=3", "--inside", "--flip", "--core-solid", "--core-gap=10", "--core-height=14", "--core-diameter=24",
+                         "--outer-sides=12", "--text-slow", "--text-depth=1", "--text-end= £ ", "--logo"}},
+   {"ten-pound-coins", {"--parts=3", "--inside", "--flip", "--core-solid", "--core-gap=10", "--core-height=28", "--core-diameter=24",
+                        "--outer-sides=12", "--text-slow", "--text-depth=1", "--text-end= £ ", "--logo"}},
+   {"easy-30x30mm", {"--parts=4", "--core-gap=10", "--core-diameter=30", "--core-height=30", "--text-slow", "--text-depth=1", "--text-end=☺",
+                     "--logo"}},
+   {"easy-50x20mm", {"--parts=4", "--core-gap=10", "--core-diameter=50", "--core-height=20", "--text-slow", "--text-depth=1", "--text-end=☺",
+                     "--logo"}},
+   {"easy-70x10mm", {"--parts=4", "--core-gap=10", "--core-diameter=70", "--core-height=10", "--text-slow", "--text-depth=1", "--text-end=☺",
+                     "--logo"}},
+   {"hard-30x30mm", {"--parts=4", "--core-gap=10", "--core-diameter=30", "--core-height=30", "--inside", "--text-slow", "--text-depth=1",
+                     "--text-end=☺", "--logo"}},
+   {"hard-50x20mm", {"--parts=4", "--core-gap=10", "--core-diameter=50", "--core-height=20", "--inside", "--text-slow", "--text-depth=1",
+                     "--text-end=☺", "--logo"}},
+   {"hard-70x10mm", {"--parts=4", "--core-gap=10", "--core-diameter=70", "--core-height=10", "--inside", "--text-slow", "--text-depth=1",
+                     "--text-end=☺", "--logo"}},
+   {"six-outside", {"--parts=6", "--core-gap=10", "--core-diameter=12", "--core-height=50", "--logo"}},
+   {"six-inside", {"--parts=6", "--core-gap=10", "--core-diameter=12", "--core-height=50", "--logo", "--inside"}},
+   {"six-outside-flip", {"--parts=6", "--core-gap=10", "--core-diameter=12", "--core-height=50", "--logo", "--flip"}},
+   {"six-inside-flip", {"--parts=6", "--core-gap=10", "--core-diameter=12", "--core-height=50", "--logo", "--flip", "--inside"}},
+   {"ten", {"--parts=10", "--core-gap=10", "--core-diameter=20", "--core-height=50", "--logo", "--text-slow", "--text-depth=1",
+            "--text-end=10\\9\\8\\7\\6\\5\\4\\3\\2\\1"}},
+};
+
+#define	BENCH_BOXES	(int)(sizeof (bench_box) / sizeof (*bench_box))
+
+static const bench_box_t bench_render_box[] = {    // Small boxes, and the same with each way of changing what is emitted
+   {"default", {NULL}},
+   {"tolerance-0.2", {"--tolerance=0.2"}},
+   {"tolerance-0.01", {"--tolerance=0.01"}},
+   {"maze-slices-5", {"--maze-slices=5"}},
+   {"maze-slices-6", {"--maze-slices=6"}},
+   {"preview", {"--preview"}},
+   {"library", {"--library"}},
+   {"text-flat", {"--text-end=AK", "--text-side=Test\\Box", "--logo"}},
+   {"text-slow", {"--text-end=AK", "--text-side=Test\\Box", "--logo", "--text-slow"}},
+   {"round", {"--outer-sides=0"}},
+   {"test-helix-3", {"--base-height=5", "--parts=2", "--core-height=15", "--core-diameter=10", "--text-end=3\\3", "--helix=3", "--logo"}},
+};
+
+#define	BENCH_RENDER_BOXES	(int)(sizeof (bench_render_box) / sizeof (*bench_render_box))
+
+static unsigned long long
+bench_hash (const char *data, size_t len)
+{                               // FNV-1a 64
+   unsigned long long h = 0xcbf29ce484222325ULL;
+   while (len--)
+   {
+      h ^= (unsigned char) *data++;
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+static int
+bench_cmp (const void *a, const void *b)
+{
+   double x = *(const double *) a,
+      y = *(const double *) b;
+   return x < y ? -1 : x > y;
+}
+
+static double
+bench_median (double *t, int n)
+{
+   qsort (t, n, sizeof (*t), bench_cmp);
+   return n & 1 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+static double
+bench_run (const bench_box_t * b, const char *extra, char **out, size_t *len)
+{                               // Make a box with stdout to memory, returns seconds
+   const char *argv[BENCH_ARGS + 4];
+   int argc = 0;
+   argv[argc++] = "puzzlebox";
+   argv[argc++] = BENCH_SEED;
+   for (int i = 0; i < BENCH_ARGS && b->arg[i]; i++)
+      argv[argc++] = b->arg[i];
+   if (extra)
+      argv[argc++] = extra;
+   argv[argc] = NULL;
+   FILE *keep = stdout;
+   if (!(stdout = open_memstream (out, len)))
+      fatal ("Cannot capture output");
+   double t = now_seconds ();
+   if (puzzlebox_main (argc, argv))
+      fatal ("Box %s failed", b->name);
+   t = now_seconds () - t;
+   fclose (stdout);             // Including anything main put in front of it
+   stdout = keep;
+   return t;
+}
+
+static int
+bench_png (const bench_box_t * b)
+{                               // Make a --png thumbnail and check every chunk's CRC, returns 0 if good
+   const char *file = "bench.png";
+   char arg[100];
+   snprintf (arg, sizeof (arg), "--png=%s", file);
+   char *out = NULL;
+   size_t len = 0;
+   bench_run (b, arg, &out, &len);
+   free (out);
+   FILE *f = fopen (file, "rb");
+   if (!f)
+      fatal ("No %s made", file);
+   static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+   unsigned char h[8];
+   int bad = (fread (h, 1, 8, f) != 8 || memcmp (h, sig, 8)),
+      chunks = 0,
+      end = 0;
+   while (!bad && !end && fread (h, 1, 8, f) == 8)
+   {                            // Length and type, then data and CRC of type and data
+      uLong n = ((uLong) h[0] << 24) | ((uLong) h[1] << 16) | ((uLong) h[2] << 8) | h[3];
+      unsigned char *d = malloc (n + 4);
+      if (!d)
+         fatal ("Out of memory");
+      if (fread (d, 1, n + 4, f) != n + 4)
+         bad = 1;
+      else
+      {
+         uLong crc = crc32 (0, h + 4, 4);
+         if (n)
+            crc = crc32 (crc, d, n);
+         if (crc != (((uLong) d[n] << 24) | ((uLong) d[n + 1] << 16) | ((uLong) d[n + 2] << 8) | d[n + 3]))
+         {
+            fprintf (stderr, "PNG chunk %.4s has a bad CRC\n", h + 4);
+            bad = 1;
+         }
+         end = !memcmp (h + 4, "IEND", 4);
+         chunks++;
+      }
+      free (d);
+   }
+   fclose (f);
+   remove (file);
+   if (!end)
+      bad = 1;
+   fprintf (stderr, "%-20s %d PNG chunks %s\n", b->name, chunks, bad ? "bad" : "ok");
+   return bad;
+}
+
+static void
+bench_maze (maze_t * m, int W, int H)
+{                               // A maze surface with the too high/low locations marked, as makemaze
+   memset (m->maze, 0, W * H);
+   m->W = W;
+   m->H = H;
+   m->helix = 3;
+   m->nubs = 3;
+   m->maxx = 0;
+   m->parkvertical = 0;
+   for (int x = 0; x < W; x++)
+      for (int y = 0; y < H; y++)
+         if (y * W + x * m->helix < (m->helix + 1) * W || y > H - 2)
+            m->maze[x * H + y] |= FLAGI;
+   m->maze[0 * H + m->helix + 1] |= FLAGR;
+   m->maze[1 * H + m->helix + 1] |= FLAGL;
+}
+
+#ifndef _WIN32
+static int
+bench_spawn (const char **args, const char *log, double *seconds, long *kb)
+{                               // Run a program with output to log, returns exit status, -1 if it cannot be run
+   extern char **environ;
+   posix_spawn_file_actions_t fa;
+   posix_spawn_file_actions_init (&fa);
+   posix_spawn_file_actions_addopen (&fa, 1, log, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   posix_spawn_file_actions_adddup2 (&fa, 1, 2);
+   pid_t pid;
+   double t = now_seconds ();
+   int e = posix_spawnp (&pid, args[0], &fa, NULL, (char **) args, environ);
+   posix_spawn_file_actions_destroy (&fa);
+   if (e)
+      return -1;
+   int status;
+   struct rusage ru;
+   if (wait4 (pid, &status, 0, &ru) != pid)
+      return -1;
+   *seconds = now_seconds () - t;
+#ifdef __APPLE__
+   *kb = ru.ru_maxrss / 1024;
+#else
+   *kb = ru.ru_maxrss;
+#endif
+   return WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+}
+
+static long long
+bench_triangles (const char *stl)
+{                               // Triangles in an ASCII or binary STL, -1 if not readable
+   FILE *f = fopen (stl, "rb");
+   if (!f)
+      return -1;
+   char line[200];
+   long long n = -1;
+   if (fgets (line, sizeof (line), f) && !strncmp (line, "solid", 5))
+   {
+      n = 0;
+      while (fgets (line, sizeof (line), f))
+         if (strstr (line, "facet normal"))
+            n++;
+   }
+   if (n <= 0 && !fseek (f, 80, SEEK_SET))
+   {                            // Binary, or ASCII with no facets
+      unsigned char c[4];
+      if (fread (c, 1, 4, f) == 4)
+         n = c[0] | c[1] << 8 | c[2] << 16 | (long long) c[3] << 24;
+   }
+   fclose (f);
+   return n;
+}
+#endif
+
+static int
+bench_render (const char *openscad)
+{                               // Render each part of the render corpus with each openscad backend, JSON to stdout
+#ifdef _WIN32
+   (void) openscad;
+   printf ("{\"render\":\"skipped\",\"error\":\"Not supported on this platform\"}\n");
+   return 0;
+#else
+   char dir[] = "/tmp/puzzlebox-bench-XXXXXX";
+   if (!mkdtemp (dir))
+      fatal ("Cannot make temporary directory");
+   char scad[100],
+     stl[100],
+     log[100];
+   snprintf (scad, sizeof (scad), "%s/part.scad", dir);
+   snprintf (stl, sizeof (stl), "%s/part.stl", dir);
+   snprintf (log, sizeof (log), "%s/part.log", dir);
+   // Which backends, from the help
+   const char *backend[2] = { NULL };
+   int backends = 0;
+   {
+      double t;
+      long kb;
+      const char *args[] = { openscad, "--help", NULL };
+      if (bench_spawn (args, log, &t, &kb) < 0)
+      {
+         printf ("{\"render\":\"skipped\",\"error\":\"Cannot run %s\"}\n", openscad);
+         unlink (log);
+         rmdir (dir);
+         return 0;
+      }
+      FILE *f = fopen (log, "r");
+      char line[500];
+      int manifold = 0;
+      while (f && fgets (line, sizeof (line), f))
+         if (strstr (line, "--backend") && strcasestr (line, "manifold"))
+            manifold = 1;
+      if (f)
+         fclose (f);
+      if (manifold)
+      {
+         backend[backends++] = "cgal";
+         backend[backends++] = "manifold";
+      } else
+         backend[backends++] = NULL;    // Only CGAL
+   }
+   FILE *fitlog[2];
+   char fitname[2][100];
+   for (int b = 0; b < backends; b++)
+   {
+      snprintf (fitname[b], sizeof (fitname[b]), "%s/fit-%d.log", dir, b);
+      if (!(fitlog[b] = fopen (fitname[b], "w")))
+         fatal ("Cannot write %s", fitname[b]);
+   }
+   printf ("{\"openscad\":\"%s\",\"render\":[", openscad);
+   int first = 1,
+      failed = 0;
+   for (int n = 0; n < BENCH_RENDER_BOXES; n++)
+   {
+      const bench_box_t *box = &bench_render_box[n];
+      char *out = NULL;
+      size_t len = 0;
+      int parts = 0;
+      bench_run (box, "--plan", &out, &len);
+      char *p = strstr (out, "\"parts\":");
+      if (!p || sscanf (p, "\"parts\":%d", &parts) != 1)
+         fatal ("Cannot plan %s", box->name);
+      free (out);
+      for (int part = 1; part <= parts; part++)
+      {
+         char arg[20];
+         snprintf (arg, sizeof (arg), "--part=%d", part);
+         long long p0 = count_points,
+            f0 = count_faces;
+         double gen = bench_run (box, arg, &out, &len);
+         long long points = count_points - p0,
+            faces = count_faces - f0;
+         FILE *f = fopen (scad, "w");
+         if (!f || fwrite (out, 1, len, f) != len || fclose (f))
+            fatal ("Cannot write %s", scad);
+         free (out);
+         if (box->arg[0] && !strcmp (box->arg[0], "--library"))
+         {                      // Needs the library next to it
+            char lib[100];
+            snprintf (lib, sizeof (lib), "%s/puzzlebox.scad", dir);
+            unlink (lib);
+            if (symlink (realpath ("puzzlebox.scad", NULL) ? : "puzzlebox.scad", lib))
+               fatal ("Cannot link %s", lib);
+         }
+         for (int b = 0; b < backends; b++)
+         {
+            double seconds = 0;
+            long kb = 0;
+            unlink (stl);
+            char opt[50];
+            snprintf (opt, sizeof (opt), "--backend=%s", backend[b] ? : "");
+            const char *args[] = { openscad, "-o", stl, scad, NULL, NULL };
+            if (backend[b])
+            {
+               args[1] = opt;
+               args[2] = "-o";
+               args[3] = stl;
+               args[4] = scad;
+            }
+            int status = bench_spawn (args, log, &seconds, &kb);
+            long long triangles = (status ? -1 : bench_triangles (stl));
+            if (status)
+               failed++;
+            else
+               fprintf (fitlog[b], "%d\t%lld\t%lld\t%.3f\t%.3f\t%d\n", part, points, faces, 0.0, seconds, status);
+            printf ("%s\n{\"box\":\"%s\",\"part\":%d,\"backend\":\"%s\",\"points\":%lld,\"faces\":%lld,\"bytes\":%zu,\"generate_ms\":%.3f,"
+                    "\"status\":%d,\"seconds\":%.3f,\"peak_kb\":%ld,\"triangles\":%lld}", first ? "" : ",", box->name, part,
+                    backend[b] ? : "cgal", points, faces, len, gen * 1000, status, seconds, kb, triangles);
+            fprintf (stderr, "%-16s part %d %-8s %8.2fs %8ldKB %8lld triangles%s\n", box->name, part, backend[b] ? : "cgal", seconds, kb,
+                     triangles, status ? " failed" : "");
+            first = 0;
+            fflush (stdout);
+         }
+      }
+   }
+   printf ("\n]}\n");
+   for (int b = 0; b < backends; b++)
+   {                            // Cost model for each backend, as --render-log
+      fclose (fitlog[b]);
+      fprintf (stderr, "%s: ", backend[b] ? : "cgal");
+      render_fit (fitname[b]);
+      unlink (fitname[b]);
+   }
+   char lib[100];
+   snprintf (lib, sizeof (lib), "%s/puzzlebox.scad", dir);
+   unlink (lib);
+   unlink (scad);
+   unlink (stl);
+   unlink (log);
+   rmdir (dir);
+   return failed ? 1 : 0;
+#endif
+}
+
+int
+main (int argc, const char *argv[])
+{
+   int runs = 5;
+   int update = 0;
+   const char *golden = "bench.golden";
+   const char *render = NULL;
+   for (int i = 1; i < argc; i++)
+      if (!strcmp (argv[i], "--runs") && i + 1 < argc)
+         runs = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "--golden") && i + 1 < argc)
+         golden = argv[++i];
+      else if (!strcmp (argv[i], "--update"))
+         update = 1;
+      else if (!strcmp (argv[i], "--render"))
+         render = (i + 1 < argc && *argv[i + 1] != '-' ? argv[++i] : "openscad");
+      else
+      {
+         fprintf (stderr, "Usage: %s [--runs N] [--golden FILE] [--update] [--render [OPENSCAD]]\n", argv[0]);
+         return 1;
+      }
+   if (runs < 1)
+      runs = 1;
+   // Same output every run, as if from the command line
+   setenv ("SOURCE_DATE_EPOCH", "0", 1);
+   unsetenv ("HTTP_HOST");
+   unsetenv ("PATH_INFO");
+   unsetenv ("QUERY_STRING");
+   unsetenv ("REMOTE_ADDR");
+   if (render)
+      return bench_render (render);
+
+   printf ("{\"runs\":%d,\"micro\":[", runs);
+   {                            // Maze generation, and test() on the result, which is maze_test() as test() in makemaze
+      const int W = 60,
+         H = 24,
+         N = 2000;
+      maze_t m;
+      if (!(m.maze = malloc (W * H)))
+         fatal ("Out of memory");
+      double best = 0;
+      long long tests = 0,
+         pushes = 0;
+      for (int r = 0; r < runs; r++)
+      {
+         long long t0 = count_tests,
+            p0 = count_pushes;
+         double t = now_seconds ();
+         for (int n = 0; n < N; n++)
+         {
+            unsigned int rng = n + 1;
+            bench_maze (&m, W, H);
+            maze_generate (&m, 1, m.helix + 1, 5, 0, 0, &rng);
+         }
+         t = now_seconds () - t;
+         if (!r || t < best)
+            best = t;
+         tests = (count_tests - t0) / N;
+         pushes = (count_pushes - p0) / N;
+      }
+      printf ("\n{\"name\":\"maze_generate\",\"W\":%d,\"H\":%d,\"us\":%.3f,\"tests\":%lld,\"pushes\":%lld}", W, H, best * 1e6 / N, tests,
+              pushes);
+      volatile unsigned char sink = 0;
+      best = 0;
+      for (int r = 0; r < runs; r++)
+      {
+         double t = now_seconds ();
+         for (int n = 0; n < N; n++)
+            for (int x = 0; x < W; x++)
+               for (int y = 0; y < H; y++)
+                  sink ^= maze_test (&m, x, y);
+         t = now_seconds () - t;
+         if (!r || t < best)
+            best = t;
+      }
+      (void) sink;
+      printf (",\n{\"name\":\"test\",\"ns\":%.3f}", best * 1e9 / N / W / H);
+      free (m.maze);
+   }
+   {                            // slice(), timed as the face phases of a box with most of its time in the maze
+      const bench_box_t *b = &bench_box[BENCH_BOXES - 1];
+      double best = 0;
+      long long slices = 0;
+      for (int r = 0; r < runs; r++)
+      {
+         char *out = NULL;
+         size_t len = 0;
+         stat_on = 1;           // Phases recorded, as --stats, without the report
+         stat_t0 = now_seconds ();
+         stat_spans = 0;
+         long long s0 = count_slices;
+         bench_run (b, NULL, &out, &len);
+         stat_on = 0;
+         free (out);
+         double t = 0;
+         for (int i = 0; i < stat_spans; i++)
+            if (!strcmp (stat_span[i].name, "faces"))
+               t += stat_span[i].end - stat_span[i].start;
+         slices = count_slices - s0;
+         if (!r || t < best)
+            best = t;
+      }
+      printf (",\n{\"name\":\"slice\",\"box\":\"%s\",\"slices\":%lld,\"ns\":%.3f}", b->name, slices, best * 1e9 / (slices ? : 1));
+   }
+   {                            // Formatter, a polyhedron of typical coordinates and quad faces to the null device
+      const int N = 200000;
+      mesh_t mesh = { 0 };
+      for (int i = 0; i < N; i++)
+      {
+         double a = i * 0.01;
+         mesh_point (&mesh, scaled (25 * sin (a)), scaled (25 * cos (a)), scaled (i * 0.0005));
+      }
+      for (int i = 0; i + 3 < N; i += 2)
+      {
+         int f[4] = { i, i + 1, i + 3, i + 2 };
+         mesh_face (&mesh, 4, f);
+      }
+      FILE *keep = stdout;
+      char *out = NULL;
+      size_t len = 0;
+      if (!(stdout = open_memstream (&out, &len)))
+         fatal ("Cannot capture output");
+      mesh_emit (&mesh, ",", "bench");
+      fclose (stdout);
+      free (out);
+#ifdef _WIN32
+      stdout = fopen ("NUL", "w");
+#else
+      stdout = fopen ("/dev/null", "w");
+#endif
+      if (!stdout)
+         fatal ("Cannot open null output");
+      int threads[2] = { 1, cpus () };  // One thread as by default, and on every CPU as with --threads
+      double best[2] = { 0 };
+      for (int k = 0; k < (threads[1] > 1 ? 2 : 1); k++)
+      {
+         mesh_threads = threads[k];
+         for (int r = 0; r < runs; r++)
+         {
+            double t = now_seconds ();
+            mesh_emit (&mesh, ",", "bench");
+            fflush (stdout);
+            t = now_seconds () - t;
+            if (!r || t < best[k])
+               best[k] = t;
+         }
+      }
+      mesh_threads = 1;
+      fclose (stdout);
+      stdout = keep;
+      for (int k = 0; k < (threads[1] > 1 ? 2 : 1); k++)
+         printf (",\n{\"name\":\"format\",\"threads\":%d,\"points\":%d,\"faces\":%d,\"bytes\":%zu,\"ns\":%.3f,\"mb_s\":%.1f}", threads[k],
+                 mesh.points, mesh.faces, len, best[k] * 1e9 / (mesh.points + mesh.faces), len / best[k] / 1e6);
+      mesh_free (&mesh);
+   }
+
+   // Macro runs, checked against the golden hashes
+   unsigned long long want[BENCH_BOXES];
+   int have[BENCH_BOXES];
+   memset (have, 0, sizeof (have));
+   FILE *g = fopen (golden, "r");
+   if (g)
+   {
+      char line[200],
+        name[100];
+      unsigned long long h;
+      while (fgets (line, sizeof (line), g))
+         if (sscanf (line, "%llx %99s", &h, name) == 2)
+            for (int b = 0; b < BENCH_BOXES; b++)
+               if (!strcmp (bench_box[b].name, name))
+               {
+                  want[b] = h;
+                  have[b] = 1;
+               }
+      fclose (g);
+   } else if (!update)
+      fprintf (stderr, "No %s, use --update to make it\n", golden);
+   int changed = 0;
+   unsigned long long hash[BENCH_BOXES];
+   printf ("],\"macro\":[");
+   for (int b = 0; b < BENCH_BOXES; b++)
+   {
+      double t[runs];
+      size_t bytes = 0;
+      for (int r = 0; r < runs; r++)
+      {
+         char *out = NULL;
+         size_t len = 0;
+         long long p0 = count_points,
+            f0 = count_faces;
+         t[r] = bench_run (&bench_box[b], NULL, &out, &len);
+         unsigned long long h = bench_hash (out, len);
+         free (out);
+         if (r && h != hash[b])
+            fatal ("Box %s is not the same each run", bench_box[b].name);
+         hash[b] = h;
+         bytes = len;
+         if (!r)
+            printf ("%s\n{\"name\":\"%s\",\"points\":%lld,\"faces\":%lld,\"bytes\":%zu", b ? "," : "", bench_box[b].name,
+                    count_points - p0, count_faces - f0, bytes);
+      }
+      const char *check = (!have[b] ? "new" : want[b] == hash[b] ? "same" : "changed");
+      if (have[b] && want[b] != hash[b])
+         changed++;
+      double min = t[0];
+      for (int r = 1; r < runs; r++)
+         if (t[r] < min)
+            min = t[r];
+      double median = bench_median (t, runs);
+      printf (",\"ms\":%.3f,\"median_ms\":%.3f,\"mb_s\":%.1f,\"hash\":\"%016llx\",\"golden\":\"%s\"}", min * 1000, median * 1000,
+              bytes / min / 1e6, hash[b], check);
+      fprintf (stderr, "%-20s %9.3fms %9zu bytes %016llx %s\n", bench_box[b].name, min * 1000, bytes, hash[b], check);
+   }
+   int pngbad = bench_png (&bench_box[1]);
+   printf ("\n],\"png\":%s,\"changed\":%d}\n", pngbad ? "false" : "true", changed);
+   if (update)
+   {
+      if (!(g = fopen (golden, "w")))
+         fatal ("Cannot write %s", golden);
+      for (int b = 0; b < BENCH_BOXES; b++)
+         fprintf (g, "%016llx %s\n", hash[b], bench_box[b].name);
+      if (fclose (g))
+         fatal ("Cannot write %s", golden);
+      fprintf (stderr, "Updated %s\n", golden);
+      return 0;
+   }
+   if (changed)
+      fprintf (stderr, "%d outputs differ from %s\n", changed, golden);
+   return changed || pngbad ? 1 : 0;
+}
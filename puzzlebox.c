@@ -3,6 +3,9 @@
 // This includes a distinctive "A" in the design at the final park point, otherwise there are no loops in the maze
 // Please leave the "A" in the design as a distinctive feature
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             // fopencookie
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -11,10 +14,31 @@
 #include <time.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_FREETYPE
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+#include <fontconfig/fontconfig.h>
+#endif
 
 #ifdef _WIN32
 #define _USE_MATH_DEFINES
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #endif
 
 // Flags for maze array
@@ -38,6 +62,11 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+#define	RENDER_COST	"2,0.0002,0.0001"       // Default render cost model, seconds: per part, per point, per face
+#define	LIBRARY_VERSION	2       // puzzlebox.scad version for --library
+#define	TOLERANCE_MIN	0.001   // Smallest --tolerance, mm
+#define	SEGMENTS_MAX	1024    // Most segments for a circle from --tolerance
+
 typedef enum
 {
    OPT_NONE,
@@ -91,14 +120,22 @@ seed_rng (void)
    }
 }
 
+static int
+random_int_r (unsigned int *state, int limit)
+{
+   if (limit <= 0)
+      return 0;
+   *state = *state * 1103515245 + 12345;
+   return (int) ((*state / 65536) % 32768) % limit;
+}
+
 static int
 random_int (int limit)
 {
    if (limit <= 0)
       return 0;
    seed_rng ();
-   rng_state = rng_state * 1103515245 + 12345;
-   return (int) ((rng_state / 65536) % 32768) % limit;
+   return random_int_r (&rng_state, limit);
 }
 
 static int
@@ -132,7 +169,10 @@ print_usage (const char *progname, const option_t *options)
    for (int i = 0; options[i].long_name; i++)
    {
       const option_t *o = &options[i];
-      printf ("  -%c, --%s", o->short_name, o->long_name);
+      if (o->short_name)
+         printf ("  -%c, --%s", o->short_name, o->long_name);
+      else
+         printf ("      --%s", o->long_name);
       if (o->type != OPT_NONE)
          printf (" %s", o->arg_desc ? o->arg_desc : "VALUE");
       printf ("\n      %s\n", o->descrip ? o->descrip : "");
@@ -173,53 +213,3285 @@ apply_option (const option_t *opt, const char *value, char *error)
    case OPT_INT:
       if (!value || parse_int (value, (int *) opt->target))
       {
-         set_error (error, 256, "Invalid integer for -%c", opt->short_name);
-         return -1;
+         set_error (error, 256, "Invalid integer for -%c", opt->short_name);
+         return -1;
+      }
+      return 0;
+   case OPT_DOUBLE:
+      if (!value || parse_double (value, (double *) opt->target))
+      {
+         set_error (error, 256, "Invalid number for -%c", opt->short_name);
+         return -1;
+      }
+      return 0;
+   case OPT_STRING:
+      if (!value)
+      {
+         set_error (error, 256, "Missing value for -%c", opt->short_name);
+         return -1;
+      }
+      {
+         char **target = (char **) opt->target;
+         free (*target);
+         *target = strdup (value);
+         if (!*target)
+         {
+            set_error (error, 256, "Out of memory");
+            return -1;
+         }
+      }
+      return 0;
+   }
+   set_error (error, 256, "Unknown option type");
+   return -1;
+}
+
+static void
+fatal (const char *fmt, ...)
+{
+   va_list args;
+   va_start (args, fmt);
+   vfprintf (stderr, fmt, args);
+   va_end (args);
+   fputc ('\n', stderr);
+   exit (1);
+}
+
+static double
+now_seconds (void)
+{                               // Monotonic wall clock
+#ifdef _WIN32
+   LARGE_INTEGER f,
+     c;
+   QueryPerformanceFrequency (&f);
+   QueryPerformanceCounter (&c);
+   return (double) c.QuadPart / f.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int
+cpus (void)
+{                               // Processors available
+#ifdef _WIN32
+   SYSTEM_INFO si;
+   GetSystemInfo (&si);
+   return si.dwNumberOfProcessors;
+#else
+   long n = sysconf (_SC_NPROCESSORS_ONLN);
+   return n > 0 ? n : 1;
+#endif
+}
+
+// Deterministic trig (--deterministic) - a table and series using only + - * / in a fixed order, so with IEEE doubles
+// and no fused multiply-add (see Makefile) the geometry is the same on every platform whatever its libm
+#define	TRIG_STEPS	1024            // Table steps per turn
+static int deterministic;       // Geometry trig from trig_sincos()
+static double trig_table[TRIG_STEPS / 4 + 1];   // sin over the first quarter turn
+static const double trig_2pi = 6.28318530717958647692528676655900577;
+
+static void
+trig_series (double x, double *s, double *c)
+{                               // sin and cos of |x| <= pi/4, Taylor series
+   double x2 = x * x;
+   *s = x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72 * (1 - x2 / 110 * (1 - x2 / 156 * (1 - x2 / 210 * (1 - x2 / 272))))))));
+   *c = 1 - x2 / 2 * (1 - x2 / 12 * (1 - x2 / 30 * (1 - x2 / 56 * (1 - x2 / 90 * (1 - x2 / 132 * (1 - x2 / 182 * (1 - x2 / 240)))))));
+}
+
+static void
+trig_sincos (double turns, double *s, double *c)
+{                               // sin and cos of an angle in turns, from the table step below it and the series for the rest
+   const int Q = TRIG_STEPS / 4;
+   if (!trig_table[Q])
+      for (int i = 0; i <= Q; i++)
+      {                         // Series to an eighth turn, and cos of the rest of the quarter after that
+         double ts,
+           tc;
+         trig_series ((i <= Q / 2 ? i : Q - i) * (trig_2pi / TRIG_STEPS), &ts, &tc);
+         trig_table[i] = (i <= Q / 2 ? ts : tc);
+      }
+   double q = turns * TRIG_STEPS,       // Exact, as a power of two
+      n = floor (q);
+   int i = (long long) n % TRIG_STEPS;
+   if (i < 0)
+      i += TRIG_STEPS;
+   double ts = trig_table[i % Q],
+      tc = trig_table[Q - i % Q],
+      S,
+      C,
+      ds,
+      dc;
+   switch (i / Q)
+   {                            // Quadrant
+   case 0:
+      S = ts;
+      C = tc;
+      break;
+   case 1:
+      S = tc;
+      C = -ts;
+      break;
+   case 2:
+      S = -ts;
+      C = -tc;
+      break;
+   default:
+      S = -tc;
+      C = ts;
+   }
+   trig_series ((q - n) * (trig_2pi / TRIG_STEPS), &ds, &dc);
+   *s = S * dc + C * ds;
+   *c = C * dc - S * ds;
+}
+
+static double
+trig_cos (double turns)
+{
+   double s,
+     c;
+   trig_sincos (turns, &s, &c);
+   return c;
+}
+
+static double
+trig_sin (double turns)
+{
+   double s,
+     c;
+   trig_sincos (turns, &s, &c);
+   return s;
+}
+
+// Box ID - version, then base64url of varint seed and the box options that are not default
+// Each option is its key (short name, or below), with 0x80 set if a double is not a whole number of 1/1000
+// then zigzag varint for int or double in 1/1000, 8 byte double, or length and text for string
+#define	BOXID_VERSION	'1'
+static const char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+typedef union
+{
+   int i;
+   double d;
+   char *s;
+} option_value_t;
+
+static int
+id_key (const option_t * o)
+{                               // Key for options that make up the box, 0 if not in the box ID
+   if (o->short_name)
+      return o->short_name;
+   if (!strcmp (o->long_name, "no-a"))
+      return 1;
+   if (!strcmp (o->long_name, "candidates"))
+      return 2;
+   if (!strcmp (o->long_name, "tolerance"))
+      return 3;
+   if (!strcmp (o->long_name, "maze-slices"))
+      return 4;
+   if (!strcmp (o->long_name, "preview"))
+      return 5;
+   if (!strcmp (o->long_name, "deterministic"))
+      return 6;
+   return 0;
+}
+
+static void
+option_get (const option_t * o, option_value_t * v)
+{
+   switch (o->type)
+   {
+   case OPT_NONE:
+   case OPT_INT:
+      v->i = *(int *) o->target;
+      break;
+   case OPT_DOUBLE:
+      v->d = *(double *) o->target;
+      break;
+   case OPT_STRING:
+      v->s = *(char **) o->target;
+      break;
+   }
+}
+
+static int
+option_is (const option_t * o, const option_value_t * v)
+{                               // Option currently has value v
+   switch (o->type)
+   {
+   case OPT_NONE:
+   case OPT_INT:
+      return *(int *) o->target == v->i;
+   case OPT_DOUBLE:
+      return *(double *) o->target == v->d;
+   case OPT_STRING:
+      {
+         char *s = *(char **) o->target;
+         return s == v->s || (s && v->s && !strcmp (s, v->s));
+      }
+   }
+   return 0;
+}
+
+static void
+put_varint (unsigned char **p, unsigned long long v)
+{
+   while (v >= 0x80)
+   {
+      *(*p)++ = (v & 0x7F) | 0x80;
+      v >>= 7;
+   }
+   *(*p)++ = v;
+}
+
+static int
+get_varint (const unsigned char **p, const unsigned char *e, unsigned long long *v)
+{
+   *v = 0;
+   for (int s = 0; s < 64; s += 7)
+   {
+      if (*p >= e)
+         return -1;
+      unsigned char c = *(*p)++;
+      *v |= (unsigned long long) (c & 0x7F) << s;
+      if (!(c & 0x80))
+         return 0;
+   }
+   return -1;
+}
+
+#define	zigzag(v)	(((unsigned long long)(v) << 1) ^ (unsigned long long)((v) < 0 ? -1LL : 0))
+#define	unzigzag(v)	((long long)((v) >> 1) ^ -(long long)((v) & 1))
+
+static char *
+box_id (const option_t * options, const option_value_t * defaults, unsigned int seed)
+{                               // Make box ID for current options (malloc)
+   size_t size = 16;
+   for (int i = 0; options[i].long_name; i++)
+      if (id_key (&options[i]) && options[i].type == OPT_STRING && *(char **) options[i].target)
+         size += strlen (*(char **) options[i].target) + 10;
+      else
+         size += 10;
+   unsigned char *data = malloc (size),
+      *p = data;
+   if (!data)
+      fatal ("Out of memory");
+   put_varint (&p, seed);
+   for (int i = 0; options[i].long_name; i++)
+   {
+      const option_t *o = &options[i];
+      int key = id_key (o);
+      if (!key || option_is (o, &defaults[i]))
+         continue;
+      switch (o->type)
+      {
+      case OPT_NONE:
+         *p++ = key;
+         break;
+      case OPT_INT:
+         *p++ = key;
+         put_varint (&p, zigzag ((long long) *(int *) o->target));
+         break;
+      case OPT_DOUBLE:
+         {
+            double v = *(double *) o->target;
+            long long t = llround (v * 1000);
+            if (fabs (v) < 1e12 && t / 1000.0 == v)
+            {
+               *p++ = key;
+               put_varint (&p, zigzag (t));
+            } else
+            {
+               *p++ = key | 0x80;
+               memcpy (p, &v, sizeof (v));      // Assumes IEEE little endian
+               p += sizeof (v);
+            }
+         }
+         break;
+      case OPT_STRING:
+         {
+            char *v = *(char **) o->target ? : "";
+            *p++ = key;
+            put_varint (&p, strlen (v));
+            memcpy (p, v, strlen (v));
+            p += strlen (v);
+         }
+         break;
+      }
+   }
+   size_t len = p - data;
+   char *id = malloc (2 + (len * 4 + 2) / 3 + 1),
+      *q = id;
+   if (!id)
+      fatal ("Out of memory");
+   *q++ = BOXID_VERSION;
+   for (size_t i = 0; i < len; i += 3)
+   {
+      unsigned int v = (data[i] << 16) | (i + 1 < len ? data[i + 1] << 8 : 0) | (i + 2 < len ? data[i + 2] : 0);
+      *q++ = base64url[v >> 18];
+      *q++ = base64url[(v >> 12) & 63];
+      if (i + 1 < len)
+         *q++ = base64url[(v >> 6) & 63];
+      if (i + 2 < len)
+         *q++ = base64url[v & 63];
+   }
+   *q = 0;
+   free (data);
+   return id;
+}
+
+static const char *
+box_from_id (const option_t * options, const option_value_t * defaults, const char *id, unsigned int *seed)
+{                               // Set box options and seed from box ID, returns error or NULL
+   if (*id++ != BOXID_VERSION)
+      return "Unknown box ID version";
+   size_t n = strlen (id);
+   unsigned char data[n],
+    *e = data;
+   unsigned int v = 0;
+   int bits = 0;
+   for (; *id; id++)
+   {
+      const char *c = strchr (base64url, *id);
+      if (!c || !*id)
+         return "Bad box ID";
+      v = (v << 6) | (c - base64url);
+      bits += 6;
+      if (bits >= 8)
+      {
+         bits -= 8;
+         *e++ = v >> bits;
+         v &= (1 << bits) - 1;
+      }
+   }
+   const unsigned char *p = data;
+   unsigned long long u;
+   if (get_varint (&p, e, &u))
+      return "Bad box ID";
+   *seed = u;
+   for (int i = 0; options[i].long_name; i++)
+      if (id_key (&options[i]))
+      {                         // Anything not in the ID is default
+         const option_t *o = &options[i];
+         switch (o->type)
+         {
+         case OPT_NONE:
+         case OPT_INT:
+            *(int *) o->target = defaults[i].i;
+            break;
+         case OPT_DOUBLE:
+            *(double *) o->target = defaults[i].d;
+            break;
+         case OPT_STRING:
+            *(char **) o->target = defaults[i].s ? strdup (defaults[i].s) : NULL;
+            break;
+         }
+      }
+   while (p < e)
+   {
+      int key = *p++,
+         i;
+      for (i = 0; options[i].long_name && id_key (&options[i]) != (key & 0x7F); i++);
+      const option_t *o = &options[i];
+      if (!o->long_name)
+         return "Unknown option in box ID";
+      switch (o->type)
+      {
+      case OPT_NONE:
+         *(int *) o->target = 1;
+         break;
+      case OPT_INT:
+         if (get_varint (&p, e, &u))
+            return "Bad box ID";
+         *(int *) o->target = unzigzag (u);
+         break;
+      case OPT_DOUBLE:
+         if (key & 0x80)
+         {
+            if (e - p < (int) sizeof (double))
+               return "Bad box ID";
+            memcpy (o->target, p, sizeof (double));
+            p += sizeof (double);
+         } else
+         {
+            if (get_varint (&p, e, &u))
+               return "Bad box ID";
+            *(double *) o->target = unzigzag (u) / 1000.0;
+         }
+         break;
+      case OPT_STRING:
+         if (get_varint (&p, e, &u) || u > (unsigned long long) (e - p))
+            return "Bad box ID";
+         {
+            char *s = malloc (u + 1);
+            if (!s)
+               return "Out of memory";
+            memcpy (s, p, u);
+            s[u] = 0;
+            p += u;
+            *(char **) o->target = s;
+         }
+         break;
+      }
+   }
+   return NULL;
+}
+
+// Compressed output - stdout is replaced by a stream that deflates to the original
+typedef struct
+{
+   FILE *out;
+   z_stream z;
+   unsigned char buf[65536];
+} deflate_sink_t;
+
+static int
+deflate_sink (deflate_sink_t * d, int flush)
+{                               // Compress what is in z and write out
+   do
+   {
+      d->z.next_out = d->buf;
+      d->z.avail_out = sizeof (d->buf);
+      int e = deflate (&d->z, flush);
+      if (e == Z_STREAM_ERROR)
+         return -1;
+      size_t n = sizeof (d->buf) - d->z.avail_out;
+      if (n && fwrite (d->buf, 1, n, d->out) != n)
+         return -1;
+   }
+   while (!d->z.avail_out);
+   return 0;
+}
+
+#ifdef __GLIBC__
+static ssize_t
+deflate_write (void *cookie, const char *data, size_t len)
+{
+   deflate_sink_t *d = cookie;
+   d->z.next_in = (unsigned char *) data;
+   d->z.avail_in = len;
+   if (deflate_sink (d, Z_NO_FLUSH))
+      return -1;
+   return len;
+}
+
+static int
+deflate_close (void *cookie)
+{
+   deflate_sink_t *d = cookie;
+   int e = deflate_sink (d, Z_FINISH);
+   deflateEnd (&d->z);
+   if (fflush (d->out))
+      e = -1;
+   free (d);
+   return e;
+}
+#endif
+
+static FILE *
+deflate_open (FILE * out, int gzip)
+{                               // Stream that compresses to out, gzip or zlib (HTTP deflate) format, NULL if not possible
+#ifdef __GLIBC__
+   deflate_sink_t *d = calloc (1, sizeof (*d));
+   if (!d)
+      return NULL;
+   d->out = out;
+   if (deflateInit2 (&d->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      free (d);
+      return NULL;
+   }
+   FILE *f = fopencookie (d, "w", (cookie_io_functions_t)
+                          {.write = deflate_write,.close = deflate_close });
+   if (f)
+      setvbuf (f, NULL, _IOFBF, 65536);
+   else
+   {
+      deflateEnd (&d->z);
+      free (d);
+   }
+   return f;
+#else
+   (void) out;
+   (void) gzip;
+   return NULL;
+#endif
+}
+
+static const char *
+accept_encoding (const char *accept)
+{                               // Compression to use for HTTP Accept-Encoding, or NULL
+   const char *best = NULL;
+   while (accept && *accept)
+   {
+      while (*accept == ' ' || *accept == ',')
+         accept++;
+      const char *e = accept;
+      while (*e && *e != ',' && *e != ';' && *e != ' ')
+         e++;
+      const char *q = e;
+      while (*q == ' ')
+         q++;
+      int ok = 1;
+      if (*q == ';')
+      {                         // q=0 means not acceptable
+         while (*++q == ' ');
+         if (*q == 'q' && q[1] == '=' && strtod (q + 2, NULL) <= 0)
+            ok = 0;
+      }
+      if (ok && e - accept == 4 && !strncasecmp (accept, "gzip", 4))
+         return "gzip";
+      if (ok && e - accept == 7 && !strncasecmp (accept, "deflate", 7))
+         best = "deflate";
+      accept = strchr (e, ',');
+   }
+   return best;
+}
+
+// Timings and counters for --stats and --trace
+static long long count_tests,   // test() calls, in makemaze and making mazes
+  count_slices,                 // slice() calls
+  count_pushes,                 // Maze queue pushes
+  count_bytes;                  // Output bytes, before compression
+// Counts of polyhedron points and faces emitted
+static long long count_points,
+  count_faces;
+static __thread long long maze_tests;   // maze_test() calls on this thread
+
+#define	STAT_COUNTS	8
+static const char *const stat_name[STAT_COUNTS] = { "tests", "slices", "pushes", "points", "faces", "bytes", "cycles", "misses" };
+
+typedef struct
+{                               // A timed phase
+   const char *name;
+   int part;                    // Part, 0 if not in one
+   int inside;                  // Maze surface, -1 if not for one
+   double start,
+     end;                       // Seconds from the start of the run
+   long long count[STAT_COUNTS];        // Counts during the phase, -1 if not available
+} stat_span_t;
+
+static int stat_on;             // --stats or --trace
+static int stat_bytes;          // Output is counted
+static double stat_t0;
+static stat_span_t *stat_span;
+static int stat_spans,
+  stat_spanmax;
+static int stat_perf[2] = { -1, -1 };   // Hardware counters, cycles and cache misses
+
+static void
+stat_counts (long long *c)
+{                               // Counts so far
+   fflush (stdout);             // Bytes are counted as written
+   c[0] = count_tests;
+   c[1] = count_slices;
+   c[2] = count_pushes;
+   c[3] = count_points;
+   c[4] = count_faces;
+   c[5] = (stat_bytes ? count_bytes : -1);
+   for (int i = 0; i < 2; i++)
+   {
+      c[6 + i] = -1;
+#ifdef __linux__
+      long long v;
+      if (stat_perf[i] >= 0 && read (stat_perf[i], &v, sizeof (v)) == sizeof (v))
+         c[6 + i] = v;
+#endif
+   }
+}
+
+static int stat_begin (const char *name, int part, int inside);
+static void stat_end (int i);
+
+static void
+stat_start (double t0)
+{                               // Start timing, from t0, with hardware counters if the system allows, the time so far being options
+   stat_on = 1;
+   stat_t0 = t0;
+#ifdef __linux__
+   struct perf_event_attr a = {.size = sizeof (a),.type = PERF_TYPE_HARDWARE,.inherit = 1,.exclude_kernel = 1,.exclude_hv = 1 };
+   a.config = PERF_COUNT_HW_CPU_CYCLES;
+   stat_perf[0] = syscall (SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+   a.config = PERF_COUNT_HW_CACHE_MISSES;
+   stat_perf[1] = syscall (SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+#endif
+   stat_end (stat_begin ("options", 0, -1));
+   stat_span[0].start = 0;
+}
+
+static int
+stat_begin (const char *name, int part, int inside)
+{                               // Start a phase, returns it for stat_end, -1 if not timing
+   if (!stat_on)
+      return -1;
+   if (stat_spans == stat_spanmax)
+   {
+      stat_spanmax = stat_spanmax * 2 + 64;
+      if (!(stat_span = realloc (stat_span, sizeof (*stat_span) * stat_spanmax)))
+         fatal ("Out of memory");
+   }
+   stat_span_t *s = &stat_span[stat_spans];
+   s->name = name;
+   s->part = part;
+   s->inside = inside;
+   stat_counts (s->count);
+   s->start = now_seconds () - stat_t0;
+   return stat_spans++;
+}
+
+static void
+stat_end (int i)
+{                               // End a phase
+   if (i < 0)
+      return;
+   stat_span_t *s = &stat_span[i];
+   s->end = now_seconds () - stat_t0;
+   long long c[STAT_COUNTS];
+   stat_counts (c);
+   for (int n = 0; n < STAT_COUNTS; n++)
+      s->count[n] = (s->count[n] < 0 || c[n] < 0 ? -1 : c[n] - s->count[n]);
+}
+
+static void
+stat_print_counts (FILE * f, const long long *c)
+{
+   for (int n = 0; n < STAT_COUNTS; n++)
+      if (c[n] >= 0)
+         fprintf (f, ",\"%s\":%lld", stat_name[n], c[n]);
+}
+
+static void
+stat_report (FILE * f)
+{                               // JSON line per part, with its maze surfaces, then the totals
+   const char *phase[] = { "maze", "points", "faces", "emit" };
+   const int phases = sizeof (phase) / sizeof (*phase);
+   double ms (int part, int inside, const char *name)
+   {                            // Total of a phase, any surface if inside is -1
+      double t = 0;
+      for (int i = 0; i < stat_spans; i++)
+         if (stat_span[i].part == part && (inside < 0 || stat_span[i].inside == inside) && !strcmp (stat_span[i].name, name))
+            t += stat_span[i].end - stat_span[i].start;
+      return t * 1000;
+   }
+   for (int i = 0; i < stat_spans; i++)
+   {
+      stat_span_t *s = &stat_span[i];
+      if (strcmp (s->name, "part"))
+         continue;
+      double other = (s->end - s->start) * 1000;
+      fprintf (f, "{\"part\":%d,\"ms\":%.3f", s->part, other);
+      for (int p = 0; p < phases; p++)
+      {
+         double t = ms (s->part, -1, phase[p]);
+         fprintf (f, ",\"%s_ms\":%.3f", phase[p], t);
+         other -= t;
+      }
+      fprintf (f, ",\"other_ms\":%.3f,\"surface\":[", other);
+      int first = 1;
+      for (int inside = 0; inside < 2; inside++)
+         if (ms (s->part, inside, "maze") > 0)
+         {
+            fprintf (f, "%s{\"inside\":%s", first ? "" : ",", inside ? "true" : "false");
+            for (int p = 0; p < phases; p++)
+               fprintf (f, ",\"%s_ms\":%.3f", phase[p], ms (s->part, inside, phase[p]));
+            fprintf (f, "}");
+            first = 0;
+         }
+      fprintf (f, "]");
+      stat_print_counts (f, s->count);
+      fprintf (f, "}\n");
+   }
+   long long c[STAT_COUNTS];
+   stat_counts (c);
+   fprintf (f, "{\"ms\":%.3f,\"options_ms\":%.3f", (now_seconds () - stat_t0) * 1000, ms (0, -1, "options"));
+   stat_print_counts (f, c);
+#ifndef _WIN32
+   struct rusage ru;
+   if (!getrusage (RUSAGE_SELF, &ru))
+#ifdef __APPLE__
+      fprintf (f, ",\"peak_kb\":%ld", (long) ru.ru_maxrss / 1024);
+#else
+      fprintf (f, ",\"peak_kb\":%ld", (long) ru.ru_maxrss);
+#endif
+#endif
+   fprintf (f, "}\n");
+}
+
+static const char *
+stat_trace (const char *filename)
+{                               // Chrome trace event JSON of the phases, returns error or NULL
+   FILE *f = fopen (filename, "w");
+   if (!f)
+      return strerror (errno);
+   fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+   for (int i = 0; i < stat_spans; i++)
+   {
+      stat_span_t *s = &stat_span[i];
+      char name[50];
+      if (!strcmp (s->name, "part"))
+         snprintf (name, sizeof (name), "part %d", s->part);
+      else if (s->inside >= 0)
+         snprintf (name, sizeof (name), "%s %s", s->name, s->inside ? "inside" : "outside");
+      else
+         snprintf (name, sizeof (name), "%s", s->name);
+      fprintf (f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"part\":%d",
+               i ? ",\n" : "", name, s->name, s->start * 1e6, (s->end - s->start) * 1e6, s->part);
+      stat_print_counts (f, s->count);
+      fprintf (f, "}}");
+   }
+   fprintf (f, "\n]}\n");
+   if (fclose (f))
+      return strerror (errno);
+   return NULL;
+}
+
+// Counted output - stdout is replaced by a stream that counts bytes written through to the original
+#ifdef __GLIBC__
+static ssize_t
+count_write (void *cookie, const char *data, size_t len)
+{
+   if (fwrite (data, 1, len, cookie) != len)
+      return -1;
+   count_bytes += len;
+   return len;
+}
+
+static int
+count_close (void *cookie)
+{
+   return fclose (cookie);
+}
+#endif
+
+static FILE *
+count_open (FILE * out)
+{                               // Stream that counts bytes and writes to out, closing it when closed, or out if not possible
+#ifdef __GLIBC__
+   FILE *f = fopencookie (out, "w", (cookie_io_functions_t)
+                          {.write = count_write,.close = count_close });
+   if (f)
+   {
+      setvbuf (f, NULL, _IOFBF, 65536);
+      stat_bytes = 1;
+      return f;
+   }
+#endif
+   return out;
+}
+
+// Pipelined output - stdout is replaced by a stream that queues full buffers for a writer thread, so making the model
+// and writing it (waiting on a pipe or disk) overlap
+#define	PIPELINE_BUFS	16      // Buffers in the queue
+#define	PIPELINE_SIZE	65536   // Bytes per buffer
+typedef struct
+{
+   int fd;                      // Where the writer thread writes
+   pthread_t thread;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;         // Signalled when buffers are queued or written, or at the end
+   char *buf[PIPELINE_BUFS];
+   size_t len[PIPELINE_BUFS];
+   int head;                    // First queued buffer
+   int queued;                  // Buffers queued, from head, including any being written
+   int slot;                    // Buffer being filled, after the queued ones
+   size_t fill;                 // Bytes in the buffer being filled
+   int end;                     // No more buffers will be queued
+   int error;                   // A write failed, the rest are discarded
+} pipeline_t;
+
+#ifdef __GLIBC__
+static int
+pipeline_writev (int fd, struct iovec *iov, int n)
+{                               // Write all of iov, 0 if OK
+   while (n)
+   {
+      ssize_t w = writev (fd, iov, n);
+      if (w < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      while (n && (size_t) w >= iov->iov_len)
+      {
+         w -= iov->iov_len;
+         iov++;
+         n--;
+      }
+      if (n)
+      {
+         iov->iov_base = (char *) iov->iov_base + w;
+         iov->iov_len -= w;
+      }
+   }
+   return 0;
+}
+
+static void *
+pipeline_writer (void *arg)
+{                               // Writer thread - write all queued buffers in one writev, until the end
+   pipeline_t *p = arg;
+   pthread_mutex_lock (&p->mutex);
+   while (1)
+   {
+      while (!p->queued && !p->end)
+         pthread_cond_wait (&p->cond, &p->mutex);
+      int n = p->queued;
+      if (!n)
+         break;
+      pthread_mutex_unlock (&p->mutex);
+      struct iovec iov[PIPELINE_BUFS];
+      for (int i = 0; i < n; i++)
+      {
+         iov[i].iov_base = p->buf[(p->head + i) % PIPELINE_BUFS];
+         iov[i].iov_len = p->len[(p->head + i) % PIPELINE_BUFS];
+      }
+      int e = (p->error ? 0 : pipeline_writev (p->fd, iov, n));
+      pthread_mutex_lock (&p->mutex);
+      if (e)
+         p->error = 1;
+      p->head = (p->head + n) % PIPELINE_BUFS;
+      p->queued -= n;
+      pthread_cond_broadcast (&p->cond);
+   }
+   pthread_mutex_unlock (&p->mutex);
+   return NULL;
+}
+
+static int
+pipeline_queue (pipeline_t * p)
+{                               // Queue the buffer being filled, and wait for one to fill next, 0 if OK
+   pthread_mutex_lock (&p->mutex);
+   p->len[p->slot] = p->fill;
+   p->queued++;
+   pthread_cond_broadcast (&p->cond);
+   while (p->queued == PIPELINE_BUFS)
+      pthread_cond_wait (&p->cond, &p->mutex);
+   int e = p->error;
+   pthread_mutex_unlock (&p->mutex);
+   p->slot = (p->slot + 1) % PIPELINE_BUFS;
+   p->fill = 0;
+   return e;
+}
+
+static ssize_t
+pipeline_write (void *cookie, const char *data, size_t len)
+{
+   pipeline_t *p = cookie;
+   size_t done = 0;
+   while (done < len)
+   {
+      size_t n = PIPELINE_SIZE - p->fill;
+      if (n > len - done)
+         n = len - done;
+      memcpy (p->buf[p->slot] + p->fill, data + done, n);
+      p->fill += n;
+      done += n;
+      if (p->fill == PIPELINE_SIZE && pipeline_queue (p))
+         return -1;
+   }
+   return len;
+}
+
+static void
+pipeline_free (pipeline_t * p)
+{
+   for (int i = 0; i < PIPELINE_BUFS; i++)
+      free (p->buf[i]);
+   pthread_cond_destroy (&p->cond);
+   pthread_mutex_destroy (&p->mutex);
+   free (p);
+}
+
+static int
+pipeline_close (void *cookie)
+{                               // Queue what is left and wait for the writer thread to write it all
+   pipeline_t *p = cookie;
+   if (p->fill)
+      pipeline_queue (p);
+   pthread_mutex_lock (&p->mutex);
+   p->end = 1;
+   pthread_cond_broadcast (&p->cond);
+   pthread_mutex_unlock (&p->mutex);
+   pthread_join (p->thread, NULL);
+   int e = (p->error ? -1 : 0);
+   pipeline_free (p);
+   return e;
+}
+#endif
+
+static FILE *
+pipeline_open (FILE * out)
+{                               // Stream that writes to the file descriptor of out from a writer thread, NULL if not possible
+#ifdef __GLIBC__
+   int fd = fileno (out);
+   if (fd < 0 || fflush (out))
+      return NULL;
+   pipeline_t *p = calloc (1, sizeof (*p));
+   if (!p)
+      return NULL;
+   p->fd = fd;
+   pthread_mutex_init (&p->mutex, NULL);
+   pthread_cond_init (&p->cond, NULL);
+   for (int i = 0; i < PIPELINE_BUFS; i++)
+      if (!(p->buf[i] = malloc (PIPELINE_SIZE)))
+      {
+         pipeline_free (p);
+         return NULL;
+      }
+   if (pthread_create (&p->thread, NULL, pipeline_writer, p))
+   {
+      pipeline_free (p);
+      return NULL;
+   }
+   FILE *f = fopencookie (p, "w", (cookie_io_functions_t)
+                          {.write = pipeline_write,.close = pipeline_close });
+   if (f)
+      setvbuf (f, NULL, _IOFBF, PIPELINE_SIZE);
+   else
+      pipeline_close (p);
+   return f;
+#else
+   (void) out;
+   return NULL;
+#endif
+}
+
+// A finished maze surface, as made in makemaze
+typedef struct
+{
+   int W,
+     H,
+     helix,
+     nubs;
+   unsigned char *maze;         // maze[x][y] flags, i.e. maze[x * H + y]
+   int maxx;                    // Entry column
+   int parkvertical;            // Park point is reached vertically
+} maze_t;
+
+typedef struct
+{                               // Maze analysis
+   int cells;                   // Usable locations (one nub's worth)
+   int path;                    // Solution moves from entry to park point
+   int deadends;
+   int junctions;               // Locations with three or more ways
+   double branch;               // Mean onward choices at a junction
+   int reversals;               // Solution moves back against previous direction
+} maze_stats_t;
+
+static unsigned char
+maze_test (const maze_t * m, int x, int y)
+{                               // Flags at x/y including all nub positions, same as test() in makemaze
+   maze_tests++;
+   while (x < 0)
+   {
+      x += m->W;
+      y -= m->helix;
+   }
+   while (x >= m->W)
+   {
+      x -= m->W;
+      y += m->helix;
+   }
+   int n = m->nubs;
+   unsigned char v = 0;
+   while (n--)
+   {
+      if (y < 0 || y >= m->H)
+         v |= FLAGI;
+      else
+         v |= m->maze[x * m->H + y];
+      if (!n)
+         break;
+      x += m->W / m->nubs;
+      while (x >= m->W)
+      {
+         x -= m->W;
+         y += m->helix;
+      }
+      if (m->helix == m->nubs)
+         y--;
+   }
+   return v;
+}
+
+static void
+maze_move (const maze_t * m, int *x, int *y, unsigned char dir)
+{                               // Move one step, wrapping round the helix
+   if (dir == FLAGR && ++*x >= m->W)
+   {
+      *x -= m->W;
+      *y += m->helix;
+   }
+   if (dir == FLAGL && --*x < 0)
+   {
+      *x += m->W;
+      *y -= m->helix;
+   }
+   if (dir == FLAGU)
+      ++*y;
+   if (dir == FLAGD)
+      --*y;
+}
+
+static int
+maze_generate (maze_t * m, int X, int Y, int complexity, int flip, int inside, unsigned int *rng)
+{                               // Make the maze from X/Y, setting entry maxx, return path length to it
+   int W = m->W,
+      H = m->H,
+      helix = m->helix,
+      nubs = m->nubs;
+   unsigned char (*maze)[H] = (void *) m->maze;
+   int max = 0;
+   long long tests = maze_tests,
+      pushes = 1;
+   typedef struct pos_s pos_t;
+   struct pos_s
+   {
+      pos_t *next;
+      int x,
+        y,
+        n;
+   };
+   pos_t *pos = malloc (sizeof (*pos)),
+      *last = NULL;
+   pos->x = X;
+   pos->y = Y;
+   pos->n = 0;
+   pos->next = NULL;
+   last = pos;
+   while (pos)
+   {
+      pos_t *p = pos;
+      pos = p->next;
+      p->next = NULL;
+      if (!pos)
+         last = NULL;
+      // Where we are
+      X = p->x;
+      Y = p->y;
+      int v,
+        n = 0;
+      // Which way can we go
+      // Some bias for direction
+      if (!maze_test (m, X + 1, Y))
+         n += BIASR;            // Right
+      if (!maze_test (m, X - 1, Y))
+         n += BIASL;            // Left
+      if (!maze_test (m, X, Y - 1))
+         n += BIASD;            // Down
+      if (!maze_test (m, X, Y + 1))
+         n += BIASU;            // Up
+      if (!n)
+      {                         // No way forward
+         free (p);
+         continue;
+      }
+      // Pick one of the ways randomly
+      v = random_int_r (rng, n);
+      // Move forward
+      if (!maze_test (m, X + 1, Y) && (v -= BIASR) < 0)
+      {                         // Right
+         maze[X][Y] |= FLAGR;
+         X++;
+         if (X >= W)
+         {
+            X -= W;
+            Y += helix;
+         }
+         maze[X][Y] |= FLAGL;
+      } else if (!maze_test (m, X - 1, Y) && (v -= BIASL) < 0)
+      {                         // Left
+         maze[X][Y] |= FLAGL;
+         X--;
+         if (X < 0)
+         {
+            X += W;
+            Y -= helix;
+         }
+         maze[X][Y] |= FLAGR;
+      } else if (!maze_test (m, X, Y - 1) && (v -= BIASD) < 0)
+      {                         // Down
+         maze[X][Y] |= FLAGD;
+         Y--;
+         maze[X][Y] |= FLAGU;
+      } else if (!maze_test (m, X, Y + 1) && (v -= BIASU) < 0)
+      {                         // Up
+         maze[X][Y] |= FLAGU;
+         Y++;
+         maze[X][Y] |= FLAGD;
+      } else
+         fatal ("Unexpected maze path");        // We should have picked a way we can go
+      // Entry
+      if (p->n > max && (maze_test (m, X, Y + 1) & FLAGI)       //
+          && (!flip || inside || !(X % (W / nubs))))
+      {                         // Longest path that reaches top
+         max = p->n;
+         m->maxx = X;
+      }
+      // Next point to consider
+      pos_t *next = malloc (sizeof (*next));
+      next->x = X;
+      next->y = Y;
+      next->n = p->n + 1;
+      next->next = NULL;
+      // How to add points to queue... start or end
+      pushes += 2;              // Next point and this one
+      v = random_int_r (rng, 10);
+      if (v < (complexity < 0 ? -complexity : complexity))
+      {                         // add next point at start - makes for longer path
+         if (!pos)
+            last = next;
+         next->next = pos;
+         pos = next;
+      } else
+      {                         // add next point at end - makes for multiple paths, which can mean very simple solution
+         if (last)
+            last->next = next;
+         else
+            pos = next;
+         last = next;
+      }
+      if (complexity <= 0 && v < -complexity)
+      {                         // current point to start
+         if (!pos)
+            last = p;
+         p->next = pos;
+         pos = p;
+      } else
+      {
+         if (last)
+            last->next = p;
+         else
+            pos = p;
+         last = p;
+      }
+   }
+   __atomic_fetch_add (&count_tests, maze_tests - tests, __ATOMIC_RELAXED);       // Candidates are made on threads
+   __atomic_fetch_add (&count_pushes, pushes, __ATOMIC_RELAXED);
+   return max;
+}
+
+static int
+maze_same (const maze_t * m, int a, int b)
+{                               // If location b (x*H+y) is location a or where another nub would be
+   int x = a / m->H,
+      y = a % m->H;
+   for (int k = 0; k < m->nubs; k++)
+   {
+      if (x * m->H + y == b)
+         return 1;
+      x += m->W / m->nubs;
+      while (x >= m->W)
+      {
+         x -= m->W;
+         y += m->helix;
+      }
+      if (m->helix == m->nubs)
+         y--;
+   }
+   return 0;
+}
+
+static int
+maze_analyse (const maze_t * m, maze_stats_t * st, int *route, int routemax)
+{                               // Solve from entry to park point, return path length (-1 if none), optional route of x*H+y
+   static const unsigned char dirs[] = { FLAGL, FLAGR, FLAGU, FLAGD };
+   int W = m->W,
+      H = m->H;
+   memset (st, 0, sizeof (*st));
+   int x = m->maxx,
+      y = H - 1;
+   while (y > 0 && (maze_test (m, x, y) & FLAGI))
+      y--;
+   int entry = x * H + y;
+   // Park point
+   x = 0;
+   y = m->helix + 1;
+   if (m->parkvertical)
+      for (y++; (maze_test (m, x, y) & FLAGD) && !(maze_test (m, x, y - 1) & FLAGI); y--);
+   int park = x * H + y;
+   int *from = malloc (sizeof (int) * W * H),
+      *queue = malloc (sizeof (int) * W * H);
+   if (!from || !queue)
+      fatal ("Out of memory");
+   for (int i = 0; i < W * H; i++)
+      from[i] = -1;
+   int head = 0,
+      tail = 0,
+      found = -1;
+   from[entry] = entry;
+   queue[tail++] = entry;
+   while (head < tail && found < 0)
+   {
+      int c = queue[head++];
+      unsigned char v = maze_test (m, c / H, c % H);
+      for (int d = 0; d < 4; d++)
+         if (v & dirs[d])
+         {
+            x = c / H;
+            y = c % H;
+            maze_move (m, &x, &y, dirs[d]);
+            if (y < 0 || y >= H || (maze_test (m, x, y) & FLAGI))
+               continue;
+            int n = x * H + y;
+            if (from[n] >= 0)
+               continue;
+            from[n] = c;
+            queue[tail++] = n;
+            if (maze_same (m, park, n))
+               found = n;       // Any nub can be the one at the park point
+         }
+   }
+   if (found >= 0)
+   {                            // Walk back, counting reversals
+      int lastv = 0,
+         lasth = 0;
+      for (int c = found; c != entry; c = from[c])
+      {
+         int p = from[c],
+            dx = c / H - p / H,
+            dyy = c % H - p % H;
+         if (dx)
+         {                      // Horizontal, back against the last horizontal move
+            int d = (dx == 1 || dx < -1 ? FLAGR : FLAGL);
+            if (lasth && d != lasth)
+               st->reversals++;
+            lasth = d;
+         } else
+         {                      // Vertical, back against the last vertical move
+            int d = (dyy > 0 ? FLAGU : FLAGD);
+            if (lastv && d != lastv)
+               st->reversals++;
+            lastv = d;
+         }
+         if (route && st->path < routemax)
+            route[st->path] = c;
+         st->path++;
+      }
+      if (route && st->path < routemax)
+         route[st->path] = entry;
+      if (route)
+         for (int i = 0, j = (st->path < routemax ? st->path : routemax - 1); i < j; i++, j--)
+         {                      // Entry first
+            int t = route[i];
+            route[i] = route[j];
+            route[j] = t;
+         }
+   } else
+      st->path = -1;
+   free (from);
+   free (queue);
+   int choices = 0;
+   for (x = 0; x < W / m->nubs; x++)
+      for (y = 0; y < H; y++)
+      {
+         unsigned char v = maze_test (m, x, y);
+         if (!(v & FLAGA) || (v & FLAGI))
+            continue;
+         st->cells++;
+         int n = 0;
+         for (int d = 0; d < 4; d++)
+            if (v & dirs[d])
+               n++;
+         if (n == 1 && !maze_same (m, park, x * H + y) && !maze_same (m, entry, x * H + y))
+            st->deadends++;
+         if (n >= 3)
+         {
+            st->junctions++;
+            choices += n - 1;
+         }
+      }
+   if (st->junctions)
+      st->branch = (double) choices / st->junctions;
+   return st->path;
+}
+
+static void
+logo_module (int n)
+{                               // Module aa(w) as polygons, the white parts of the A&A logo, circles of n segments
+   void circle (double x, double r)
+   {
+      for (int i = 0; i < n; i++)
+         if (deterministic)
+            printf ("%s[%.3f,%.3f]", i ? "," : "", x + r * trig_cos ((double) i / n), r * trig_sin ((double) i / n));
+         else
+            printf ("%s[%.3f,%.3f]", i ? "," : "", x + r * cos (2 * M_PI * i / n), r * sin (2 * M_PI * i / n));
+   }
+   void paths (void)
+   {
+      printf ("],paths=[[");
+      for (int i = 0; i < n * 2; i++)
+         printf ("%s%d", i == n ? "],[" : i ? "," : "", i);
+      printf ("]]);");
+   }
+   printf ("module aa(w=100){scale(w/100){polygon(points=[");
+   circle (0, 50);
+   printf (",");
+   circle (0, 46);
+   paths ();
+   printf ("for(m=[0,1])mirror([m,0,0]){polygon(points=[");
+   circle (24, 22.5);
+   printf (",");
+   circle (24, 15);
+   paths ();
+   printf ("polygon([[1.5,22],[9,22],[9,-18.5],[1.5,-22]]);}}} // A&A Logo is copyright (c) 2013 and trademark Andrews & Arnold Ltd\n");
+}
+
+// Unrolled maze drawings, for --svg
+typedef struct
+{
+   int part;
+   int inside;
+   int a;                       // "A" at the park point
+   maze_t m;                    // With its own copy of the maze
+} svg_maze_t;
+
+static void
+svg_write (FILE * f, const svg_maze_t * s, int count, int solution)
+{                               // Each maze surface unrolled, with passages, entry column, park point, and optionally the solution
+   const int u = 12,            // Pixels per maze location
+      margin = 20,
+      label = 16;
+   double lo[count],
+     hi[count];                 // Range of rows, allowing for helix
+   int width = 0,
+      height = margin;
+   for (int i = 0; i < count; i++)
+   {
+      const maze_t *m = &s[i].m;
+      lo[i] = m->H;
+      hi[i] = 0;
+      for (int X = 0; X < m->W; X++)
+         for (int Y = 0; Y < m->H; Y++)
+         {
+            unsigned char v = maze_test (m, X, Y);
+            if (!(v & FLAGA) || (v & FLAGI))
+               continue;
+            double z = Y + (double) X * m->helix / m->W;
+            if (z < lo[i])
+               lo[i] = z;
+            if (z > hi[i])
+               hi[i] = z;
+         }
+      if (lo[i] > hi[i])
+         lo[i] = hi[i] = 0;
+      if ((m->W + 1) * u + margin * 2 > width)
+         width = (m->W + 1) * u + margin * 2;
+      height += label + (hi[i] - lo[i] + 2) * u + margin;
+   }
+   fprintf (f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+   fprintf (f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n", width, height, width,
+            height);
+   fprintf (f, "<rect width=\"100%%\" height=\"100%%\" fill=\"#fff\"/>\n");
+   int top = margin;
+   for (int i = 0; i < count; i++)
+   {
+      const maze_t *m = &s[i].m;
+      int W = m->W,
+         H = m->H;
+      double skew = (double) m->helix / W;
+      double x (double X)
+      {
+         return margin + (X + 0.5) * u;
+      }
+      double y (double X, double Y)
+      {
+         return top + label + (hi[i] - Y - X * skew + 1) * u;
+      }
+      fprintf (f, "<text x=\"%d\" y=\"%d\" font-family=\"sans-serif\" font-size=\"12\">Part %d %s %d/%d</text>\n", margin,
+               top + 12, s[i].part, s[i].inside ? "inside" : "outside", W, H - 2 - m->helix);
+      for (int X = m->maxx % (W / m->nubs); X < W; X += W / m->nubs)
+         fprintf (f, "<rect x=\"%.1f\" y=\"%d\" width=\"%d\" height=\"%.1f\" fill=\"#fe9\"/>\n", x (X - 0.5), top + label, u,
+                  (hi[i] - lo[i] + 2) * u);     // Entry column, for each nub
+      fprintf (f, "<path fill=\"none\" stroke=\"#333\" stroke-width=\"%d\" stroke-linecap=\"round\" d=\"", u / 2);
+      for (int X = 0; X < W; X++)
+         for (int Y = 0; Y < H; Y++)
+         {
+            unsigned char v = maze_test (m, X, Y);
+            if (!(v & FLAGA) || (v & FLAGI))
+               continue;
+            fprintf (f, "M%.1f %.1fh0", x (X), y (X, Y));
+            if (v & FLAGR)      // To X+1, past the edge for the last column, as unrolled
+               fprintf (f, "L%.1f %.1f", x (X + 1), y (X + 1, Y));
+            if (v & FLAGU)
+               fprintf (f, "M%.1f %.1fL%.1f %.1f", x (X), y (X, Y), x (X), y (X, Y + 1));
+            if (!X && (v & FLAGL))
+               fprintf (f, "M%.1f %.1fL%.1f %.1f", x (X), y (X, Y), x (X - 0.5), y (X - 0.5, Y));
+         }
+      fprintf (f, "\"/>\n");
+      int px = 0,
+         py = m->helix + 1;     // Park point, as maze_analyse
+      if (m->parkvertical)
+         for (py++; (maze_test (m, px, py) & FLAGD) && !(maze_test (m, px, py - 1) & FLAGI); py--);
+      if (solution)
+      {
+         int *route = malloc (sizeof (int) * (W * H + 1));
+         maze_stats_t st;
+         if (!route)
+            fatal ("Out of memory");
+         int n = maze_analyse (m, &st, route, W * H + 1);
+         if (n > 0)
+         {
+            fprintf (f, "<path fill=\"none\" stroke=\"#d22\" stroke-width=\"%d\" stroke-linecap=\"round\" stroke-linejoin=\"round\" d=\"M%.1f %.1f",
+                     u / 4, x (route[0] / H), y (route[0] / H, route[0] % H));
+            for (int r = 1; r <= n; r++)
+            {
+               int X = route[r] / H,
+                  Y = route[r] % H,
+                  dx = X - route[r - 1] / H;
+               if (dx < -1)     // Off the right edge and back on the left
+                  fprintf (f, "L%.1f %.1fM%.1f %.1f", x (W - 0.5), y (W - 0.5, Y - m->helix), x (-0.5), y (-0.5, Y));
+               else if (dx > 1) // Off the left edge and back on the right
+                  fprintf (f, "L%.1f %.1fM%.1f %.1f", x (-0.5), y (-0.5, Y + m->helix), x (W - 0.5), y (W - 0.5, Y));
+               fprintf (f, "L%.1f %.1f", x (X), y (X, Y));
+               px = X;
+               py = Y;          // Ends at whichever nub is at the park point
+            }
+            fprintf (f, "\"/>\n");
+         }
+         free (route);
+      }
+      fprintf (f, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"%d\" fill=\"#2a2\"/>\n", x (px), y (px, py), u / 3);
+      if (s[i].a)
+         fprintf (f, "<text x=\"%.1f\" y=\"%.1f\" font-family=\"sans-serif\" font-size=\"%d\" font-weight=\"bold\" fill=\"#2a2\">A</text>\n",
+                  x (px + 2), y (px + 2, py + 1), u);
+      top += label + (hi[i] - lo[i] + 2) * u + margin;
+   }
+   fprintf (f, "</svg>\n");
+}
+
+// Maze file, for --maze-out and --maze-in
+// "PBMZ" and version, then in order made, 'M' records for each maze surface and 'E' for random part angles
+// B: mazes made(32), difficulty(double) - before an M record for a best of many maze (version 2)
+// M: part, inside, W(16), H(16), helix, nubs, maxx(16), path length(16, 65535 for test pattern), run length flags
+// E: part, angle(16)
+#define	MAZEFILE_MAGIC	"PBMZ"
+#define	MAZEFILE_VERSION	2       // Version 1 files, without B records, can still be read
+
+static void
+put16 (FILE * f, int v)
+{
+   putc (v & 0xFF, f);
+   putc ((v >> 8) & 0xFF, f);
+}
+
+static int
+get16 (FILE * f)
+{
+   int l = getc (f),
+      h = getc (f);
+   if (l < 0 || h < 0)
+      return -1;
+   return l + (h << 8);
+}
+
+static void
+mazefile_start (FILE * f)
+{
+   fputs (MAZEFILE_MAGIC, f);
+   putc (MAZEFILE_VERSION, f);
+}
+
+static const char *
+mazefile_check (FILE * f)
+{
+   char magic[sizeof (MAZEFILE_MAGIC) - 1];
+   if (fread (magic, sizeof (magic), 1, f) != 1 || memcmp (magic, MAZEFILE_MAGIC, sizeof (magic)))
+      return "Not a maze file";
+   int v = getc (f);
+   if (v < 1 || v > MAZEFILE_VERSION)
+      return "Unknown maze file version";
+   return NULL;
+}
+
+static const char *
+mazefile_find (FILE * f, int type, int part, int inside)
+{                               // Seek to the M (with any B before it) or E record for this part, whichever parts the file was made for
+   const char *bad = "Bad maze file";
+   if (fseek (f, sizeof (MAZEFILE_MAGIC), SEEK_SET))    // Magic and version
+      return bad;
+   long at;
+   while (1)
+   {
+      at = ftell (f);
+      int c = getc (f);
+      if (c < 0)
+         return type == 'M' ? "Maze file does not have this maze" : "Maze file does not have this part angle";
+      if (c == 'E')
+      {
+         int p = getc (f);
+         if (get16 (f) < 0)
+            return bad;
+         if (type == 'E' && p == part)
+            break;
+         continue;
+      }
+      if (c == 'B')
+      {
+         double score;
+         if (get16 (f) < 0 || get16 (f) < 0 || fread (&score, sizeof (score), 1, f) != 1)
+            return bad;
+         c = getc (f);
+      }
+      if (c != 'M')
+         return bad;
+      int p = getc (f),
+         i = getc (f),
+         W = get16 (f),
+         H = get16 (f);
+      if (getc (f) < 0 || getc (f) < 0 || get16 (f) < 0 || get16 (f) < 0 || W < 0 || H < 0)
+         return bad;
+      if (type == 'M' && p == part && i == inside)
+         break;
+      for (int n = W * H; n > 0;)
+      {                         // Skip the flags
+         int r = getc (f);
+         if (r < 0 || getc (f) < 0)
+            return bad;
+         n -= r + 1;
+      }
+   }
+   if (fseek (f, at, SEEK_SET))
+      return bad;
+   return NULL;
+}
+
+static const char *
+maze_save (FILE * f, int part, int inside, const maze_t * m, int max, int made, double score)
+{                               // Flags are stored as (run-1, value) pairs, made and score if best of many
+   if (m->W > 65535 || m->H > 65535 || m->maxx > 65535 || max >= 65535 || part > 255 || m->helix > 255 || m->nubs > 255)
+      return "Maze too large for a maze file";
+   if (made)
+   {
+      putc ('B', f);
+      put16 (f, made);
+      put16 (f, made >> 16);
+      fwrite (&score, sizeof (score), 1, f);    // Assumes IEEE little endian
+   }
+   putc ('M', f);
+   putc (part, f);
+   putc (inside, f);
+   put16 (f, m->W);
+   put16 (f, m->H);
+   putc (m->helix, f);
+   putc (m->nubs, f);
+   put16 (f, m->maxx);
+   put16 (f, max < 0 ? 65535 : max);
+   int n = m->W * m->H;
+   for (int i = 0; i < n;)
+   {
+      int r = 1;
+      while (r < 256 && i + r < n && m->maze[i + r] == m->maze[i])
+         r++;
+      putc (r - 1, f);
+      putc (m->maze[i], f);
+      i += r;
+   }
+   return NULL;
+}
+
+static const char *
+maze_load (FILE * f, int part, int inside, maze_t * m, int *max, int *made, double *score)
+{                               // Load maze for this surface in to m, which must have W/H/helix/nubs set, made 0 if not best of many
+   const char *e = mazefile_find (f, 'M', part, inside);
+   if (e)
+      return e;
+   int c = getc (f);
+   *made = 0;
+   if (c == 'B')
+   {
+      int l = get16 (f),
+         h = get16 (f);
+      if (l < 0 || h < 0 || fread (score, sizeof (*score), 1, f) != 1)
+         return "Bad maze file";
+      *made = l + (h << 16);
+      c = getc (f);
+   }
+   if (c != 'M' || getc (f) != part || getc (f) != inside)
+      return "Maze file does not have this maze";
+   if (get16 (f) != m->W || get16 (f) != m->H || getc (f) != m->helix || getc (f) != m->nubs)
+      return "Maze file does not match size";
+   m->maxx = get16 (f);
+   *max = get16 (f);
+   if (*max == 65535)
+      *max = -1;
+   if (m->maxx < 0 || m->maxx >= m->W || (*max < 0 && *max != -1))
+      return "Bad maze file";
+   int n = m->W * m->H;
+   for (int i = 0; i < n;)
+   {
+      int r = getc (f),
+         v = getc (f);
+      if (r < 0 || v < 0 || i + r + 1 > n)
+         return "Bad maze file";
+      memset (m->maze + i, v, r + 1);
+      i += r + 1;
+   }
+   return NULL;
+}
+
+static void
+angle_save (FILE * f, int part, int a)
+{
+   putc ('E', f);
+   putc (part, f);
+   put16 (f, a);
+}
+
+static const char *
+angle_load (FILE * f, int part, int *a)
+{
+   const char *e = mazefile_find (f, 'E', part, 0);
+   if (e)
+      return e;
+   if (getc (f) != 'E' || getc (f) != part || (*a = get16 (f)) < 0 || *a >= 360)
+      return "Maze file does not have this part angle";
+   return NULL;
+}
+
+static double
+maze_score (const maze_stats_t * st)
+{                               // Difficulty - long solution, with reversals and dead ends to mislead
+   if (st->path < 0)
+      return -1;
+   return st->path + 3.0 * st->reversals + 0.5 * st->deadends;
+}
+
+static unsigned int
+maze_seed (unsigned int seed, int n)
+{                               // Independent RNG stream for candidate n
+   unsigned int x = seed + 0x9E3779B9u * (n + 1);
+   x ^= x >> 16;
+   x *= 0x85EBCA6Bu;
+   x ^= x >> 13;
+   x *= 0xC2B2AE35u;
+   x ^= x >> 16;
+   return x;
+}
+
+typedef struct
+{                               // Best of N maze search
+   const maze_t *m;             // Maze with only the limits and park point set
+   int X,
+     Y,
+     complexity,
+     flip,
+     inside;
+   unsigned int seed;
+   int candidates;              // 0 for no limit
+   double deadline;             // 0 for no limit
+   pthread_mutex_t lock;
+   int next;                    // Next candidate
+   int number;                  // Best so far
+   double score;
+   int max;
+   int maxx;
+   unsigned char *best;
+   int failed;                  // A thread could not allocate its candidate, reported once joined
+} maze_search_t;
+
+static void *
+maze_search (void *arg)
+{                               // Make and score candidates until out of candidates or time
+   maze_search_t *ms = arg;
+   size_t size = (size_t) ms->m->W * ms->m->H;
+   maze_t c = *ms->m;
+   c.maze = malloc (size);
+   if (!c.maze)
+   {                            // Not fatal () on a worker thread
+      pthread_mutex_lock (&ms->lock);
+      ms->failed = 1;
+      pthread_mutex_unlock (&ms->lock);
+      return NULL;
+   }
+   while (1)
+   {
+      pthread_mutex_lock (&ms->lock);
+      int n = ms->next++;
+      pthread_mutex_unlock (&ms->lock);
+      if (n && ((ms->candidates && n >= ms->candidates) || (ms->deadline && now_seconds () >= ms->deadline)))
+         break;
+      memcpy (c.maze, ms->m->maze, size);
+      unsigned int rng = maze_seed (ms->seed, n);
+      int max = maze_generate (&c, ms->X, ms->Y, ms->complexity, ms->flip, ms->inside, &rng);
+      maze_stats_t st;
+      maze_analyse (&c, &st, NULL, 0);
+      double score = maze_score (&st);
+      pthread_mutex_lock (&ms->lock);
+      if (ms->number < 0 || score > ms->score || (score == ms->score && n < ms->number))
+      {                         // Lowest number wins a tie so result does not depend on threads
+         ms->number = n;
+         ms->score = score;
+         ms->max = max;
+         ms->maxx = c.maxx;
+         memcpy (ms->best, c.maze, size);
+      }
+      pthread_mutex_unlock (&ms->lock);
+   }
+   free (c.maze);
+   return NULL;
+}
+
+static int
+maze_best (maze_t * m, int X, int Y, int complexity, int flip, int inside, unsigned int seed, int candidates, int budget,
+           int threads, int *made, double *score)
+{                               // Make best of a number of candidate mazes, in parallel, return path length to entry
+   maze_search_t ms = {.m = m,.X = X,.Y = Y,.complexity = complexity,.flip = flip,.inside = inside,.seed = seed,.candidates =
+         candidates,.number = -1 };
+   if (budget > 0)
+      ms.deadline = now_seconds () + budget / 1000.0;
+   if (!(ms.best = malloc ((size_t) m->W * m->H)))
+      fatal ("Out of memory");
+   pthread_mutex_init (&ms.lock, NULL);
+   if (threads <= 0)
+      threads = cpus ();
+   if (candidates && threads > candidates)
+      threads = candidates;
+   pthread_t t[threads];
+   int started = 0;             // Other threads
+   for (int i = 1; i < threads; i++)
+      if (!pthread_create (&t[started], NULL, maze_search, &ms))
+         started++;
+   maze_search (&ms);
+   for (int i = 0; i < started; i++)
+      pthread_join (t[i], NULL);
+   pthread_mutex_destroy (&ms.lock);
+   if (ms.failed)
+      fatal ("Out of memory");
+   memcpy (m->maze, ms.best, (size_t) m->W * m->H);
+   free (ms.best);
+   m->maxx = ms.maxx;
+   if (made)
+      *made = ms.next - started - 1;    // Each thread took one more number to find it had finished
+   if (score)
+      *score = ms.score;
+   return ms.max;
+}
+
+// Render driver - runs openscad on each generated part
+typedef struct
+{
+   int part;
+   long long points;            // Polyhedron points/faces emitted for this part
+   long long faces;
+   double cost;                 // Predicted render seconds
+   double start;
+   double seconds;              // Actual render seconds
+   int status;
+   long pid;
+   char scad[256];
+   char stl[256];
+   char log[256];
+} render_job_t;
+
+static int
+render_cmp (const void *a, const void *b)
+{                               // Largest predicted cost first
+   double ca = ((const render_job_t *) a)->cost,
+      cb = ((const render_job_t *) b)->cost;
+   return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+static void
+render_names (render_job_t * j, const char *prefix, const char *what, int n)
+{                               // File names for a job, prefix-what-n.scad/.stl/.log
+   if (snprintf (j->scad, sizeof (j->scad), "%s-%s-%d.scad", prefix, what, n) >= (int) sizeof (j->scad)
+       || snprintf (j->stl, sizeof (j->stl), "%s-%s-%d.stl", prefix, what, n) >= (int) sizeof (j->stl)
+       || snprintf (j->log, sizeof (j->log), "%s-%s-%d.log", prefix, what, n) >= (int) sizeof (j->log))
+      fatal ("File prefix too long [%s]", prefix);
+}
+
+static int
+render_model (const char *spec, double k[3])
+{                               // Parse cost model coefficients
+   char *end;
+   const char *p = spec;
+   for (int i = 0; i < 3; i++)
+   {
+      k[i] = strtod (p, &end);
+      if (end == p || (i < 2 ? *end != ',' : *end))
+         return -1;
+      p = end + 1;
+   }
+   return 0;
+}
+
+static void
+render_fit (const char *logfile)
+{                               // Least squares fit of cost model from all logged timings
+   FILE *f = fopen (logfile, "r");
+   if (!f)
+      return;
+   double a[3][4] = { {0} };
+   double lo[4],
+     hi[4];                     // Range of points, faces and seconds, there is nothing to fit if any is the same throughout
+   int rows = 0;
+   char line[512];
+   while (fgets (line, sizeof (line), f))
+   {
+      int part,
+        status;
+      long long points,
+        faces;
+      double predicted,
+        actual;
+      if (sscanf (line, "%d\t%lld\t%lld\t%lf\t%lf\t%d", &part, &points, &faces, &predicted, &actual, &status) != 6 || status)
+         continue;
+      double v[3] = { 1, points, faces };
+      for (int i = 1; i < 4; i++)
+      {
+         double x = (i < 3 ? v[i] : actual);
+         if (!rows || x < lo[i])
+            lo[i] = x;
+         if (!rows || x > hi[i])
+            hi[i] = x;
+      }
+      for (int i = 0; i < 3; i++)
+      {
+         for (int j = 0; j < 3; j++)
+            a[i][j] += v[i] * v[j];
+         a[i][3] += v[i] * actual;
+      }
+      rows++;
+   }
+   fclose (f);
+   if (rows < 3)
+      return;
+   for (int i = 1; i < 4; i++)
+      if (lo[i] == hi[i])
+      {
+         fprintf (stderr, "// %d renders do not vary enough to fit --render-cost\n", rows);
+         return;
+      }
+   for (int i = 0; i < 3; i++)
+   {                            // Gauss-Jordan
+      int m = i;
+      for (int j = i + 1; j < 3; j++)
+         if (fabs (a[j][i]) > fabs (a[m][i]))
+            m = j;
+      if (fabs (a[m][i]) < 1e-12)
+         return;
+      for (int j = 0; j < 4; j++)
+      {
+         double t = a[i][j];
+         a[i][j] = a[m][j];
+         a[m][j] = t;
+      }
+      for (int j = 0; j < 3; j++)
+         if (j != i)
+         {
+            double r = a[j][i] / a[i][i];
+            for (int c = i; c < 4; c++)
+               a[j][c] -= r * a[i][c];
+         }
+   }
+   fprintf (stderr, "// Fitted from %d renders: --render-cost=%g,%g,%g\n", rows, a[0][3] / a[0][0], a[1][3] / a[1][1],
+            a[2][3] / a[2][2]);
+}
+
+static int
+render_parts (render_job_t *jobs, int count, int workers, const char *logfile)
+{                               // Run openscad on a bounded pool of workers, largest job first
+#ifdef _WIN32
+   (void) jobs;
+   (void) count;
+   (void) workers;
+   (void) logfile;
+   fprintf (stderr, "Render not supported on this platform\n");
+   return 1;
+#else
+   extern char **environ;
+   if (workers <= 0)
+      workers = cpus ();
+   qsort (jobs, count, sizeof (*jobs), render_cmp);
+   int next = 0,
+      running = 0,
+      failed = 0;
+   double start = now_seconds ();
+   while (next < count || running)
+   {
+      while (next < count && running < workers)
+      {
+         render_job_t *j = &jobs[next++];
+         posix_spawn_file_actions_t fa;
+         posix_spawn_file_actions_init (&fa);
+         posix_spawn_file_actions_addopen (&fa, 1, j->log, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+         posix_spawn_file_actions_adddup2 (&fa, 1, 2);
+         char *args[] = { "openscad", "-o", j->stl, j->scad, NULL };
+         pid_t pid;
+         j->start = now_seconds ();
+         int e = posix_spawnp (&pid, "openscad", &fa, NULL, args, environ);
+         posix_spawn_file_actions_destroy (&fa);
+         if (e)
+         {
+            fprintf (stderr, "Cannot run openscad: %s\n", strerror (e));
+            j->status = -1;
+            failed++;
+            continue;
+         }
+         j->pid = pid;
+         running++;
+      }
+      if (!running)
+         break;
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+      for (int i = 0; i < next; i++)
+         if (jobs[i].pid == pid)
+         {
+            render_job_t *j = &jobs[i];
+            j->seconds = now_seconds () - j->start;
+            j->status = (WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+            j->pid = 0;
+            running--;
+            if (j->status)
+               failed++;
+            fprintf (stderr, "// Part %d %s in %.1fs (predicted %.1fs) %s\n", j->part, j->status ? "failed" : "rendered",
+                     j->seconds, j->cost, j->status ? j->log : j->stl);
+         }
+   }
+   fprintf (stderr, "// Rendered %d parts on %d workers in %.1fs\n", count, workers, now_seconds () - start);
+   if (logfile)
+   {                            // Timings for recalibrating the cost model
+      FILE *f = fopen (logfile, "a");
+      if (f)
+      {
+         for (int i = 0; i < count; i++)
+            if (jobs[i].status >= 0)
+               fprintf (f, "%d\t%lld\t%lld\t%.3f\t%.3f\t%d\n", jobs[i].part, jobs[i].points, jobs[i].faces, jobs[i].cost,
+                        jobs[i].seconds, jobs[i].status);
+         fclose (f);
+         render_fit (logfile);
+      }
+   }
+   return failed ? 1 : 0;
+#endif
+}
+
+// Plating - parts from one or more boxes packed on to print beds
+typedef struct
+{
+   int box;                     // Box number, in order given
+   int part;
+   double r;                    // Footprint, outer radius
+   long long points,
+     faces;                     // Polyhedron sizes, from plan
+   int plate;                   // Where packed, centre
+   double x,
+     y;
+} plate_item_t;
+
+static int
+plate_cmp (const void * a, const void * b)
+{                               // Largest first, then in order given
+   const plate_item_t *A = a,
+      *B = b;
+   if (A->r != B->r)
+      return A->r > B->r ? -1 : 1;
+   if (A->box != B->box)
+      return A->box - B->box;
+   return A->part - B->part;
+}
+
+static int
+plate_pack (plate_item_t * item, int count, double w, double h, double gap)
+{                               // Circle packing, largest first, each at the lowest then leftmost place it fits on the first plate it fits, returns plates
+   qsort (item, count, sizeof (*item), plate_cmp);
+   int plates = 0;
+   for (int n = 0; n < count; n++)
+   {
+      plate_item_t *c = &item[n];
+      if (c->r * 2 > w || c->r * 2 > h)
+         fatal ("Box %d part %d (%.1fmm) does not fit the bed", c->box, c->part, c->r * 2);
+      c->plate = -1;
+      for (int p = 0; p <= plates && c->plate < 0; p++)
+      {
+         int found = 0;
+         double bx = 0,
+            by = 0;
+         void fit (double x, double y)
+         {                      // Consider a place
+            if (x < c->r - 1e-6 || y < c->r - 1e-6 || x > w - c->r + 1e-6 || y > h - c->r + 1e-6)
+               return;
+            if (found && (y > by + 1e-6 || (y > by - 1e-6 && x >= bx)))
+               return;
+            for (int i = 0; i < n; i++)
+               if (item[i].plate == p && hypot (x - item[i].x, y - item[i].y) < c->r + item[i].r + gap - 1e-6)
+                  return;
+            found = 1;
+            bx = x;
+            by = y;
+         }
+         fit (c->r, c->r);
+         for (int i = 0; i < n; i++)
+         {
+            plate_item_t *d = &item[i];
+            if (d->plate != p)
+               continue;
+            double R = c->r + d->r + gap,
+               e;
+            if ((e = R * R - (c->r - d->y) * (c->r - d->y)) >= 0)
+            {                   // On the bottom edge, touching d
+               fit (d->x + sqrt (e), c->r);
+               fit (d->x - sqrt (e), c->r);
+            }
+            if ((e = R * R - (c->r - d->x) * (c->r - d->x)) >= 0)
+            {                   // On the left edge, touching d
+               fit (c->r, d->y + sqrt (e));
+               fit (c->r, d->y - sqrt (e));
+            }
+            for (int j = i + 1; j < n; j++)
+            {                   // Touching d and f
+               plate_item_t *f = &item[j];
+               if (f->plate != p)
+                  continue;
+               double Rf = c->r + f->r + gap,
+                  dx = f->x - d->x,
+                  dy = f->y - d->y,
+                  l = hypot (dx, dy);
+               if (l <= 0 || l > R + Rf || l < fabs (R - Rf))
+                  continue;
+               double a = (R * R - Rf * Rf + l * l) / (2 * l),
+                  q = sqrt (fmax (0, R * R - a * a));
+               fit (d->x + (a * dx - q * dy) / l, d->y + (a * dy + q * dx) / l);
+               fit (d->x + (a * dx + q * dy) / l, d->y + (a * dy - q * dx) / l);
+            }
+         }
+         if (found)
+         {
+            c->plate = p;
+            c->x = bx;
+            c->y = by;
+         }
+      }
+      if (c->plate == plates)
+         plates++;
+   }
+   return plates;
+}
+
+static int
+plate_child (int (*run) (int, const char *[]), int argc, const char *argv[], FILE * out)
+{                               // Run the generator in a child process writing to out, returns exit status
+#ifdef _WIN32
+   (void) run;
+   (void) argc;
+   (void) argv;
+   (void) out;
+   fatal ("Plating not supported on this platform");
+   return -1;
+#else
+   fflush (stdout);
+   fflush (out);
+   pid_t pid = fork ();
+   if (pid < 0)
+      fatal ("Cannot fork");
+   if (!pid)
+   {
+      unsetenv ("PATH_INFO");   // Arguments only
+      unsetenv ("QUERY_STRING");
+      stdout = out;
+      int r = run (argc, argv);
+      fflush (stdout);
+      _exit (r);
+   }
+   int status;
+   if (waitpid (pid, &status, 0) != pid || !WIFEXITED (status))
+      return -1;
+   return WEXITSTATUS (status);
+#endif
+}
+
+#define	W4(W)	((long long)(W)*4)     // Slices round a maze
+
+// Polyhedron, captured so it can be checked and cleaned before it is emitted
+typedef struct
+{
+   int points,
+     pointmax;
+   long long (*point)[3];
+   int faces,
+     facemax;
+   int *face;                   // Start of each face in index, ends at start of next
+   int indexes,
+     indexmax;
+   int *index;
+} mesh_t;
+
+static int checkmesh;           // Check and clean each polyhedron (--check-mesh)
+static int mesh_failures;       // Polyhedrons that failed the check
+
+static void
+mesh_point (mesh_t * m, long long x, long long y, long long z)
+{                               // Add a point
+   if (m->points == m->pointmax)
+   {
+      m->pointmax = m->pointmax * 2 + 256;
+      m->point = realloc (m->point, sizeof (*m->point) * m->pointmax);
+      if (!m->point)
+         fatal ("Out of memory");
+   }
+   m->point[m->points][0] = x;
+   m->point[m->points][1] = y;
+   m->point[m->points][2] = z;
+   m->points++;
+}
+
+static void
+mesh_face (mesh_t * m, int n, const int *v)
+{                               // Add a face of n points
+   if (m->faces + 1 >= m->facemax)
+   {
+      m->facemax = m->facemax * 2 + 256;
+      m->face = realloc (m->face, sizeof (*m->face) * m->facemax);
+      if (!m->face)
+         fatal ("Out of memory");
+   }
+   if (m->indexes + n > m->indexmax)
+   {
+      m->indexmax = m->indexmax * 2 + n + 1024;
+      m->index = realloc (m->index, sizeof (*m->index) * m->indexmax);
+      if (!m->index)
+         fatal ("Out of memory");
+   }
+   m->face[m->faces++] = m->indexes;
+   memcpy (m->index + m->indexes, v, sizeof (*v) * n);
+   m->indexes += n;
+   m->face[m->faces] = m->indexes;
+}
+
+static void
+mesh_free (mesh_t * m)
+{
+   free (m->point);
+   free (m->face);
+   free (m->index);
+   memset (m, 0, sizeof (*m));
+}
+
+static unsigned int
+mesh_hash (unsigned long long k)
+{                               // Hash for point and edge tables
+   k ^= k >> 33;
+   k *= 0xff51afd7ed558ccdULL;
+   k ^= k >> 33;
+   return k;
+}
+
+static int
+mesh_check (mesh_t * m, const char *name)
+{                               // Weld coincident points, drop degenerate faces, check every edge has two opposite faces, report to stderr
+   int size = 1024;
+   while (size < m->points * 2 || size < m->indexes * 2)
+      size *= 2;
+   int *table = malloc (sizeof (int) * size);
+   int *map = malloc (sizeof (int) * (m->points + 1));
+   if (!table || !map)
+      fatal ("Out of memory");
+   // Weld, points are already rounded by scaled() so coincident means equal
+   memset (table, -1, sizeof (int) * size);
+   int points = 0;
+   for (int i = 0; i < m->points; i++)
+   {
+      long long *p = m->point[i];
+      unsigned int h = mesh_hash (p[0] * 0x9E3779B97F4A7C15ULL ^ p[1] * 0xC2B2AE3D27D4EB4FULL ^ p[2]);
+      while (table[h & (size - 1)] >= 0 && memcmp (m->point[table[h & (size - 1)]], p, sizeof (*m->point)))
+         h++;
+      if (table[h & (size - 1)] < 0)
+      {
+         memmove (m->point[points], p, sizeof (*m->point));
+         table[h & (size - 1)] = points++;
+      }
+      map[i] = table[h & (size - 1)];
+   }
+   int original = m->points,
+      welded = m->points - points;
+   m->points = points;
+   // Degenerate faces
+   int faces = 0,
+      indexes = 0,
+      degenerate = 0,
+      bad = 0;
+   for (int f = 0; f < m->faces; f++)
+   {
+      int start = indexes;
+      for (int i = m->face[f]; i < m->face[f + 1]; i++)
+      {
+         int v = m->index[i];
+         if (v < 0 || v >= original)
+         {
+            bad++;
+            continue;
+         }
+         v = map[v];
+         if (indexes > start && m->index[indexes - 1] == v)
+            continue;           // Repeated point
+         m->index[indexes++] = v;
+      }
+      while (indexes - start > 1 && m->index[indexes - 1] == m->index[start])
+         indexes--;             // Closing point repeated
+      long long nx = 0,
+         ny = 0,
+         nz = 0;                // Newell normal, zero if no area
+      for (int i = start; i < indexes; i++)
+      {
+         long long *a = m->point[m->index[i]],
+            *b = m->point[m->index[i + 1 < indexes ? i + 1 : start]];
+         nx += (a[1] - b[1]) * (a[2] + b[2]);
+         ny += (a[2] - b[2]) * (a[0] + b[0]);
+         nz += (a[0] - b[0]) * (a[1] + b[1]);
+      }
+      if (indexes - start < 3 || (!nx && !ny && !nz))
+      {
+         degenerate++;
+         indexes = start;
+         continue;
+      }
+      m->face[faces++] = start;
+   }
+   m->faces = faces;
+   m->indexes = indexes;
+   m->face[faces] = indexes;
+   // Edges, keyed on lower point, counting each direction
+   struct
+   {
+      unsigned long long key;
+      int up,
+        down;
+   } *edge = calloc (size, sizeof (*edge));
+   if (!edge)
+      fatal ("Out of memory");
+   int edges = 0,
+      open = 0,
+      multiple = 0,
+      flipped = 0;
+   for (int f = 0; f < m->faces; f++)
+      for (int i = m->face[f]; i < m->face[f + 1]; i++)
+      {
+         int a = m->index[i],
+            b = m->index[i + 1 < m->face[f + 1] ? i + 1 : m->face[f]];
+         unsigned long long key = ((unsigned long long) (a < b ? a : b) << 32 | (unsigned) (a < b ? b : a)) + 1;
+         unsigned int h = mesh_hash (key);
+         while (edge[h & (size - 1)].key && edge[h & (size - 1)].key != key)
+            h++;
+         if (!edge[h & (size - 1)].key)
+         {
+            edge[h & (size - 1)].key = key;
+            edges++;
+         }
+         if (a < b)
+            edge[h & (size - 1)].up++;
+         else
+            edge[h & (size - 1)].down++;
+      }
+   for (int e = 0; e < size; e++)
+      if (edge[e].key)
+      {
+         if (edge[e].up + edge[e].down > 2)
+            multiple++;
+         else if (edge[e].up == 2 || edge[e].down == 2)
+            flipped++;
+         else if (edge[e].up != 1 || edge[e].down != 1)
+            open++;
+      }
+   free (edge);
+   free (map);
+   free (table);
+   int failed = bad + open + multiple + flipped;
+   fprintf (stderr,
+            "%s: %d points (%d welded), %d faces (%d degenerate dropped), %d edges, %d open, %d non-manifold, %d misoriented, %d bad index%s\n",
+            name, m->points, welded, m->faces, degenerate, edges, open, multiple, flipped, bad, failed ? " - FAILED" : "");
+   if (failed)
+      mesh_failures++;
+   return failed;
+}
+
+static void
+mesh_points (FILE * o, const mesh_t * m, int from, int to)
+{                               // Print points from to before to
+   for (int i = from; i < to; i++)
+      fprintf (o, "[%lld,%lld,%lld],", m->point[i][0], m->point[i][1], m->point[i][2]);
+}
+
+static void
+mesh_faces (FILE * o, const mesh_t * m, int from, int to)
+{                               // Print faces from to before to
+   for (int f = from; f < to; f++)
+   {
+      fprintf (o, "[");
+      for (int i = m->face[f]; i < m->face[f + 1]; i++)
+         fprintf (o, "%s%d", i > m->face[f] ? "," : "", m->index[i]);
+      fprintf (o, "],");
+   }
+}
+
+// A large polyhedron is printed on threads, in chunks of points then faces each to its own buffer, written in order
+#define	MESH_CHUNK	16384   // Points or faces per chunk
+static int mesh_threads = 1;    // Threads to print a polyhedron (--threads)
+
+typedef struct
+{
+   const mesh_t *m;
+   int pointchunks;             // Chunks of points, then of faces
+   int chunks;
+   char **buf;                  // Printed chunks
+   size_t *len;
+   pthread_mutex_t lock;
+   int next;                    // Next chunk
+} mesh_print_t;
+
+#ifndef _WIN32
+static void *
+mesh_print (void *arg)
+{                               // Print chunks until all taken
+   mesh_print_t *mp = arg;
+   while (1)
+   {
+      pthread_mutex_lock (&mp->lock);
+      int c = mp->next++;
+      pthread_mutex_unlock (&mp->lock);
+      if (c >= mp->chunks)
+         break;
+      FILE *o = open_memstream (&mp->buf[c], &mp->len[c]);
+      if (!o)
+         fatal ("Out of memory");
+      if (c < mp->pointchunks)
+         mesh_points (o, mp->m, c * MESH_CHUNK, (c + 1) * MESH_CHUNK < mp->m->points ? (c + 1) * MESH_CHUNK : mp->m->points);
+      else
+      {
+         int f = (c - mp->pointchunks) * MESH_CHUNK;
+         mesh_faces (o, mp->m, f, f + MESH_CHUNK < mp->m->faces ? f + MESH_CHUNK : mp->m->faces);
+      }
+      if (fclose (o))
+         fatal ("Out of memory");
+   }
+   return NULL;
+}
+#endif
+
+static void
+mesh_emit (mesh_t * m, const char *sep, const char *name)
+{                               // Print points and faces, checked first if --check-mesh
+   if (checkmesh)
+      mesh_check (m, name);
+   mesh_print_t mp = {.m = m,.pointchunks = (m->points + MESH_CHUNK - 1) / MESH_CHUNK };
+   mp.chunks = mp.pointchunks + (m->faces + MESH_CHUNK - 1) / MESH_CHUNK;
+#ifdef _WIN32
+   int threads = 1;             // No open_memstream on MinGW, so printed on one thread
+#else
+   int threads = (mesh_threads < mp.chunks ? mesh_threads : mp.chunks);
+#endif
+   if (threads <= 1)
+   {                            // Small, or one thread
+      printf ("points=[");
+      mesh_points (stdout, m, 0, m->points);
+      printf ("]%sfaces=[", sep);
+      mesh_faces (stdout, m, 0, m->faces);
+      printf ("]");
+      return;
+   }
+#ifndef _WIN32
+   mp.buf = calloc (mp.chunks, sizeof (*mp.buf));
+   mp.len = calloc (mp.chunks, sizeof (*mp.len));
+   if (!mp.buf || !mp.len)
+      fatal ("Out of memory");
+   pthread_mutex_init (&mp.lock, NULL);
+   pthread_t t[threads];
+   int started = 0;             // Other threads
+   for (int i = 1; i < threads; i++)
+      if (!pthread_create (&t[started], NULL, mesh_print, &mp))
+         started++;
+   mesh_print (&mp);
+   for (int i = 0; i < started; i++)
+      pthread_join (t[i], NULL);
+   pthread_mutex_destroy (&mp.lock);
+   printf ("points=[");
+   for (int c = 0; c < mp.chunks; c++)
+   {
+      if (c == mp.pointchunks)
+         printf ("]%sfaces=[", sep);
+      fwrite (mp.buf[c], 1, mp.len[c], stdout);
+      free (mp.buf[c]);
+   }
+   if (!m->faces)
+      printf ("]%sfaces=[", sep);
+   printf ("]");
+   free (mp.buf);
+   free (mp.len);
+#endif
+}
+
+// Scene of triangles for --png and --glb, the polyhedrons as made plus simple shells, an approximation of the final shapes
+typedef struct
+{
+   int tris,
+     trimax;
+   float (*tri)[9];             // Corners, mm
+   unsigned char *part;         // Part, for colour
+} scene_t;
+
+static void
+scene_tri (scene_t * s, int part, const double *a, const double *b, const double *c)
+{                               // Add a triangle
+   if (s->tris == s->trimax)
+   {
+      s->trimax = s->trimax * 2 + 1024;
+      s->tri = realloc (s->tri, sizeof (*s->tri) * s->trimax);
+      s->part = realloc (s->part, s->trimax);
+      if (!s->tri || !s->part)
+         fatal ("Out of memory");
+   }
+   for (int i = 0; i < 3; i++)
+   {
+      s->tri[s->tris][i] = a[i];
+      s->tri[s->tris][3 + i] = b[i];
+      s->tri[s->tris][6 + i] = c[i];
+   }
+   s->part[s->tris++] = part;
+}
+
+static void
+scene_mesh (scene_t * s, const mesh_t * m, int part, double x, double y, double angle, int copies, int mirror)
+{                               // Add a polyhedron, mirrored in X, then rotated (degrees) for each copy and moved to x/y
+   for (int n = 0; n < copies; n++)
+   {
+      double a = (angle + (double) 360 * n / copies) * M_PI / 180,
+         sa = sin (a),
+         ca = cos (a);
+      void corner (int i, double *p)
+      {
+         double px = (double) m->point[i][0] / SCALE * (mirror ? -1 : 1),
+            py = (double) m->point[i][1] / SCALE;
+         p[0] = x + px * ca - py * sa;
+         p[1] = y + px * sa + py * ca;
+         p[2] = (double) m->point[i][2] / SCALE;
+      }
+      for (int f = 0; f < m->faces; f++)
+      {                         // Fan from first point
+         double a[3],
+           b[3],
+           c[3];
+         corner (m->index[m->face[f]], a);
+         corner (m->index[m->face[f] + 1], b);
+         for (int i = m->face[f] + 2; i < m->face[f + 1]; i++)
+         {
+            corner (m->index[i], c);
+            scene_tri (s, part, a, b, c);
+            memcpy (b, c, sizeof (b));
+         }
+      }
+   }
+}
+
+static void
+scene_ring (scene_t * s, int part, double x, double y, double angle, double r0, double r1, int sides, double z0, double z1)
+{                               // Add a tube (solid if r0 is 0), as a cylinder with the sides given, rotated (degrees)
+   for (int n = 0; n < sides; n++)
+   {
+      double a0 = angle * M_PI / 180 + M_PI * 2 * n / sides,
+         a1 = angle * M_PI / 180 + M_PI * 2 * (n + 1) / sides;
+      double o00[3] = { x + r1 * cos (a0), y + r1 * sin (a0), z0 },
+         o10[3] = { x + r1 * cos (a1), y + r1 * sin (a1), z0 },
+         o01[3] = { x + r1 * cos (a0), y + r1 * sin (a0), z1 },
+         o11[3] = { x + r1 * cos (a1), y + r1 * sin (a1), z1 };
+      double i00[3] = { x + r0 * cos (a0), y + r0 * sin (a0), z0 },
+         i10[3] = { x + r0 * cos (a1), y + r0 * sin (a1), z0 },
+         i01[3] = { x + r0 * cos (a0), y + r0 * sin (a0), z1 },
+         i11[3] = { x + r0 * cos (a1), y + r0 * sin (a1), z1 };
+      scene_tri (s, part, o00, o10, o11);
+      scene_tri (s, part, o00, o11, o01);
+      scene_tri (s, part, i01, o01, o11);
+      scene_tri (s, part, i01, o11, i11);
+      scene_tri (s, part, i00, o10, o00);
+      scene_tri (s, part, i00, i10, o10);
+      if (r0 > 0)
+      {
+         scene_tri (s, part, i00, i11, i10);
+         scene_tri (s, part, i00, i01, i11);
+      }
+   }
+}
+
+static void
+scene_place (scene_t * s, int from)
+{                               // Move triangles from the one given to the right of those before, for parts made at the origin
+   if (!from || from == s->tris)
+      return;
+   double max = -1e30,
+      min = 1e30;
+   for (int n = 0; n < s->tris; n++)
+      for (int c = 0; c < 9; c += 3)
+      {
+         if (n < from)
+            max = fmax (max, s->tri[n][c]);
+         else
+            min = fmin (min, s->tri[n][c]);
+      }
+   for (int n = from; n < s->tris; n++)
+      for (int c = 0; c < 9; c += 3)
+         s->tri[n][c] += max + 5 - min;
+}
+
+static void
+png_chunk (FILE * f, const char *type, const unsigned char *data, unsigned int len)
+{
+   unsigned char b[4] = { len >> 24, len >> 16, len >> 8, len };
+   fwrite (b, 1, 4, f);
+   fwrite (type, 1, 4, f);
+   if (len)
+      fwrite (data, 1, len, f);
+   uLong crc = crc32 (0, (const Bytef *) type, 4);
+   if (len)
+      crc = crc32 (crc, data, len);     // crc32 () with a NULL buffer returns the initial value, not crc
+   unsigned char c[4] = { crc >> 24, crc >> 16, crc >> 8, crc };
+   fwrite (c, 1, 4, f);
+}
+
+static const char *
+png_write (const char *filename, int w, int h, const unsigned char *rgb)
+{                               // 8 bit RGB PNG, returns error or NULL
+   uLong rawlen = (uLong) (w * 3 + 1) * h;
+   unsigned char *raw = malloc (rawlen);
+   uLongf zlen = compressBound (rawlen);
+   unsigned char *z = malloc (zlen);
+   if (!raw || !z)
+      fatal ("Out of memory");
+   for (int y = 0; y < h; y++)
+   {
+      raw[y * (w * 3 + 1)] = 0; // No filter
+      memcpy (raw + y * (w * 3 + 1) + 1, rgb + y * w * 3, w * 3);
+   }
+   const char *e = NULL;
+   if (compress2 (z, &zlen, raw, rawlen, 6) != Z_OK)
+      e = "Compress failed";
+   FILE *f = NULL;
+   if (!e && !(f = fopen (filename, "wb")))
+      e = "Cannot write";
+   if (!e)
+   {
+      unsigned char ihdr[13] = { w >> 24, w >> 16, w >> 8, w, h >> 24, h >> 16, h >> 8, h, 8, 2, 0, 0, 0 };
+      fwrite ("\x89PNG\r\n\x1a\n", 1, 8, f);
+      png_chunk (f, "IHDR", ihdr, sizeof (ihdr));
+      png_chunk (f, "IDAT", z, zlen);
+      png_chunk (f, "IEND", NULL, 0);
+      if (fclose (f))
+         e = "Write failed";
+   }
+   free (raw);
+   free (z);
+   return e;
+}
+
+#define	SCENE_TILE	32           // Pixels square per tile
+#define	SCENE_SS	2              // Super sampling
+
+typedef struct
+{                               // Shared by the tile workers
+   const scene_t *s;
+   float (*v)[9];               // Screen x, y, depth for each corner
+   unsigned char (*colour)[3];  // Shaded colour of each triangle
+   int **bin,                   // Triangles for each tile
+    *bins;
+   int w,
+     h,
+     tilesx,
+     tiles;
+   unsigned char *rgb;          // Super sampled image
+   int next;
+   pthread_mutex_t lock;
+} scene_render_t;
+
+static void *
+scene_tiles (void *arg)
+{                               // Render tiles until all done
+   scene_render_t *r = arg;
+   float depth[SCENE_TILE * SCENE_TILE];
+   while (1)
+   {
+      pthread_mutex_lock (&r->lock);
+      int t = r->next++;
+      pthread_mutex_unlock (&r->lock);
+      if (t >= r->tiles)
+         break;
+      int x0 = t % r->tilesx * SCENE_TILE,
+         y0 = t / r->tilesx * SCENE_TILE;
+      for (int i = 0; i < SCENE_TILE * SCENE_TILE; i++)
+         depth[i] = 1e30;
+      for (int b = 0; b < r->bins[t]; b++)
+      {
+         int n = r->bin[t][b];
+         const float *v = r->v[n];
+         float area = (v[3] - v[0]) * (v[7] - v[1]) - (v[4] - v[1]) * (v[6] - v[0]);
+         if (fabsf (area) < 1e-12)
+            continue;
+         int xa = floorf (fminf (v[0], fminf (v[3], v[6]))),
+            xb = ceilf (fmaxf (v[0], fmaxf (v[3], v[6]))),
+            ya = floorf (fminf (v[1], fminf (v[4], v[7]))),
+            yb = ceilf (fmaxf (v[1], fmaxf (v[4], v[7])));
+         if (xa < x0)
+            xa = x0;
+         if (ya < y0)
+            ya = y0;
+         if (xb > x0 + SCENE_TILE)
+            xb = x0 + SCENE_TILE;
+         if (yb > y0 + SCENE_TILE)
+            yb = y0 + SCENE_TILE;
+         if (xb > r->w)
+            xb = r->w;
+         if (yb > r->h)
+            yb = r->h;
+         for (int y = ya; y < yb; y++)
+            for (int x = xa; x < xb; x++)
+            {                   // Barycentric, at pixel centre
+               float px = x + 0.5,
+                  py = y + 0.5;
+               float w0 = ((v[3] - px) * (v[7] - py) - (v[4] - py) * (v[6] - px)) / area,
+                  w1 = ((v[6] - px) * (v[1] - py) - (v[7] - py) * (v[0] - px)) / area,
+                  w2 = 1 - w0 - w1;
+               if (w0 < 0 || w1 < 0 || w2 < 0)
+                  continue;
+               float d = w0 * v[2] + w1 * v[5] + w2 * v[8];
+               float *z = &depth[(y - y0) * SCENE_TILE + x - x0];
+               if (d >= *z)
+                  continue;
+               *z = d;
+               memcpy (r->rgb + ((size_t) y * r->w + x) * 3, r->colour[n], 3);
+            }
+      }
+   }
+   return NULL;
+}
+
+static const char *
+scene_png (const scene_t * s, const char *filename, int width, int height, int threads)
+{                               // Render the scene from a fixed camera, shaded, to PNG, returns error or NULL
+   const double az = -30 * M_PI / 180,
+      el = 30 * M_PI / 180;     // Camera
+   const double light[3] = { -0.36, -0.48, 0.8 };
+   static const unsigned char palette[][3] = { {90, 140, 220}, {230, 150, 60}, {110, 190, 110}, {200, 90, 160}, {200, 200, 80}, {90, 190, 200} };
+   scene_render_t r = {.s = s,.w = width * SCENE_SS,.h = height * SCENE_SS };
+   r.v = malloc (sizeof (*r.v) * (s->tris + 1));
+   r.colour = malloc (sizeof (*r.colour) * (s->tris + 1));
+   r.rgb = malloc ((size_t) r.w * r.h * 3);
+   if (!r.v || !r.colour || !r.rgb)
+      fatal ("Out of memory");
+   memset (r.rgb, 255, (size_t) r.w * r.h * 3);
+   // Project, orthographic, screen Y down
+   double minx = 1e30,
+      maxx = -1e30,
+      miny = 1e30,
+      maxy = -1e30;
+   for (int n = 0; n < s->tris; n++)
+   {
+      const float *t = s->tri[n];
+      for (int c = 0; c < 3; c++)
+      {
+         double x = t[c * 3] * cos (az) - t[c * 3 + 1] * sin (az),
+            y = t[c * 3] * sin (az) + t[c * 3 + 1] * cos (az),
+            z = t[c * 3 + 2];
+         r.v[n][c * 3] = x;
+         r.v[n][c * 3 + 1] = -(y * sin (el) + z * cos (el));
+         r.v[n][c * 3 + 2] = y * cos (el) - z * sin (el);
+         if (r.v[n][c * 3] < minx)
+            minx = r.v[n][c * 3];
+         if (r.v[n][c * 3] > maxx)
+            maxx = r.v[n][c * 3];
+         if (r.v[n][c * 3 + 1] < miny)
+            miny = r.v[n][c * 3 + 1];
+         if (r.v[n][c * 3 + 1] > maxy)
+            maxy = r.v[n][c * 3 + 1];
+      }
+      double e1[3] = { t[3] - t[0], t[4] - t[1], t[5] - t[2] },
+         e2[3] = { t[6] - t[0], t[7] - t[1], t[8] - t[2] };
+      double nx = e1[1] * e2[2] - e1[2] * e2[1],
+         ny = e1[2] * e2[0] - e1[0] * e2[2],
+         nz = e1[0] * e2[1] - e1[1] * e2[0],
+         l = sqrt (nx * nx + ny * ny + nz * nz);
+      double shade = 0.3 + 0.7 * (l > 0 ? fabs (nx * light[0] + ny * light[1] + nz * light[2]) / l : 0);        // Two sided
+      const unsigned char *p = palette[(s->part[n] + sizeof (palette) / sizeof (*palette) - 1) % (sizeof (palette) / sizeof (*palette))];
+      for (int c = 0; c < 3; c++)
+         r.colour[n][c] = p[c] * shade;
+   }
+   double scale = 1;
+   if (maxx > minx && maxy > miny)
+      scale = fmin (r.w * 0.92 / (maxx - minx), r.h * 0.92 / (maxy - miny));
+   for (int n = 0; n < s->tris; n++)
+      for (int c = 0; c < 3; c++)
+      {
+         r.v[n][c * 3] = (r.v[n][c * 3] - (minx + maxx) / 2) * scale + r.w / 2.0;
+         r.v[n][c * 3 + 1] = (r.v[n][c * 3 + 1] - (miny + maxy) / 2) * scale + r.h / 2.0;
+      }
+   // Bin triangles to tiles
+   r.tilesx = (r.w + SCENE_TILE - 1) / SCENE_TILE;
+   r.tiles = r.tilesx * ((r.h + SCENE_TILE - 1) / SCENE_TILE);
+   r.bin = calloc (r.tiles, sizeof (*r.bin));
+   r.bins = calloc (r.tiles, sizeof (*r.bins));
+   int *binmax = calloc (r.tiles, sizeof (*binmax));
+   if (!r.bin || !r.bins || !binmax)
+      fatal ("Out of memory");
+   for (int n = 0; n < s->tris; n++)
+   {
+      const float *v = r.v[n];
+      int xa = fmaxf (0, fminf (v[0], fminf (v[3], v[6]))) / SCENE_TILE,
+         xb = fminf (r.w - 1, fmaxf (v[0], fmaxf (v[3], v[6]))) / SCENE_TILE,
+         ya = fmaxf (0, fminf (v[1], fminf (v[4], v[7]))) / SCENE_TILE,
+         yb = fminf (r.h - 1, fmaxf (v[1], fmaxf (v[4], v[7]))) / SCENE_TILE;
+      for (int ty = ya; ty <= yb; ty++)
+         for (int tx = xa; tx <= xb; tx++)
+         {
+            int t = ty * r.tilesx + tx;
+            if (r.bins[t] == binmax[t])
+            {
+               binmax[t] = binmax[t] * 2 + 64;
+               if (!(r.bin[t] = realloc (r.bin[t], sizeof (int) * binmax[t])))
+                  fatal ("Out of memory");
+            }
+            r.bin[t][r.bins[t]++] = n;
+         }
+   }
+   // Render
+   pthread_mutex_init (&r.lock, NULL);
+   if (threads <= 0)
+      threads = cpus ();
+   if (threads > r.tiles)
+      threads = r.tiles;
+   pthread_t t[threads];
+   int started = 0;             // Other threads
+   for (int i = 1; i < threads; i++)
+      if (!pthread_create (&t[started], NULL, scene_tiles, &r))
+         started++;
+   scene_tiles (&r);
+   for (int i = 0; i < started; i++)
+      pthread_join (t[i], NULL);
+   pthread_mutex_destroy (&r.lock);
+   // Down sample
+   unsigned char *rgb = malloc ((size_t) width * height * 3);
+   if (!rgb)
+      fatal ("Out of memory");
+   for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+         for (int c = 0; c < 3; c++)
+         {
+            int sum = 0;
+            for (int dy = 0; dy < SCENE_SS; dy++)
+               for (int dx = 0; dx < SCENE_SS; dx++)
+                  sum += r.rgb[((size_t) (y * SCENE_SS + dy) * r.w + x * SCENE_SS + dx) * 3 + c];
+            rgb[((size_t) y * width + x) * 3 + c] = sum / (SCENE_SS * SCENE_SS);
+         }
+   const char *e = png_write (filename, width, height, rgb);
+   for (int i = 0; i < r.tiles; i++)
+      free (r.bin[i]);
+   free (r.bin);
+   free (r.bins);
+   free (binmax);
+   free (r.v);
+   free (r.colour);
+   free (r.rgb);
+   free (rgb);
+   return e;
+}
+
+// glTF binary, for --glb, a mesh per part with KHR_mesh_quantization
+// Positions are 16 bit steps across the part's bounding box, scaled back by the part's node, indices 16 bit if they fit
+static void
+glb_put (unsigned char **p, size_t * len, size_t * max, const void *data, size_t n)
+{                               // Append to buffer
+   if (*len + n > *max)
+   {
+      *max = (*len + n) * 2 + 65536;
+      if (!(*p = realloc (*p, *max)))
+         fatal ("Out of memory");
+   }
+   if (data)
+      memcpy (*p + *len, data, n);
+   else
+      memset (*p + *len, 0, n);
+   *len += n;
+}
+
+typedef struct
+{                               // Growable text, MinGW has no open_memstream
+   char *p;
+   size_t len,
+     max;
+} glb_text_t;
+
+static void
+glb_printf (glb_text_t * t, const char *fmt, ...)
+{                               // Append formatted text, kept NUL terminated
+   va_list ap;
+   va_start (ap, fmt);
+   int n = vsnprintf (NULL, 0, fmt, ap);
+   va_end (ap);
+   if (n < 0)
+      fatal ("Bad format");
+   if (t->len + n + 1 > t->max)
+   {
+      t->max = (t->len + n + 1) * 2 + 4096;
+      if (!(t->p = realloc (t->p, t->max)))
+         fatal ("Out of memory");
+   }
+   va_start (ap, fmt);
+   vsnprintf (t->p + t->len, n + 1, fmt, ap);
+   va_end (ap);
+   t->len += n;
+}
+
+static const char *
+glb_write (FILE * f, const scene_t * s)
+{                               // Write the scene as GLB, returns error or NULL
+   static const float palette[][3] = { {0.35, 0.55, 0.86}, {0.9, 0.59, 0.24}, {0.43, 0.75, 0.43}, {0.78, 0.35, 0.63}, {0.78, 0.78, 0.31}, {0.35, 0.75, 0.78} };
+   unsigned char *bin = NULL;
+   size_t binlen = 0,
+      binmax = 0;
+   glb_text_t j = { 0 };
+   int parts = 0;
+   for (int n = 0; n < s->tris; n++)
+      if (s->part[n] > parts)
+         parts = s->part[n];
+   glb_printf (&j, "{\"asset\":{\"version\":\"2.0\",\"generator\":\"puzzlebox\"},"
+               "\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"],"
+               "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],");
+   // Root node turns Z up mm into Y up metres
+   glb_printf (&j, "\"nodes\":[{\"rotation\":[-0.70710678,0,0,0.70710678],\"scale\":[0.001,0.001,0.001],\"children\":[");
+   int meshes = 0;
+   for (int part = 1; part <= parts; part++)
+      for (int n = 0; n < s->tris; n++)
+         if (s->part[n] == part)
+         {
+            glb_printf (&j, "%s%d", meshes ? "," : "", meshes + 1);
+            meshes++;
+            break;
+         }
+   glb_printf (&j, "]}");
+   glb_text_t a = { 0 },
+      v = { 0 },
+      m = { 0 },
+      c = { 0 };
+   meshes = 0;
+   for (int part = 1; part <= parts; part++)
+   {
+      double min[3] = { 1e30, 1e30, 1e30 },
+         max[3] = { -1e30, -1e30, -1e30 };
+      int tris = 0;
+      for (int n = 0; n < s->tris; n++)
+         if (s->part[n] == part)
+         {
+            tris++;
+            for (int i = 0; i < 9; i++)
+            {
+               min[i % 3] = fmin (min[i % 3], s->tri[n][i]);
+               max[i % 3] = fmax (max[i % 3], s->tri[n][i]);
+            }
+         }
+      if (!tris)
+         continue;
+      double step[3];
+      for (int i = 0; i < 3; i++)
+         step[i] = (max[i] > min[i] ? (max[i] - min[i]) / 65535 : 1);
+      // Weld corners that quantise the same
+      int hashsize = 1;
+      while (hashsize < tris * 6)
+         hashsize *= 2;
+      unsigned long long *key = malloc (sizeof (*key) * hashsize);
+      int *hash = calloc (hashsize, sizeof (*hash)),
+         *index = malloc (sizeof (*index) * tris * 3);
+      unsigned short (*q)[4] = malloc (sizeof (*q) * tris * 3);
+      if (!key || !hash || !index || !q)
+         fatal ("Out of memory");
+      int points = 0,
+         indexes = 0;
+      unsigned short qmin[3] = { 65535, 65535, 65535 },
+         qmax[3] = { 0 };
+      for (int n = 0; n < s->tris; n++)
+         if (s->part[n] == part)
+            for (int i = 0; i < 9; i += 3)
+            {
+               unsigned short p[4] = { 0 };
+               for (int k = 0; k < 3; k++)
+                  p[k] = lround ((s->tri[n][i + k] - min[k]) / step[k]);
+               unsigned long long k = ((unsigned long long) p[0] << 32 | (unsigned long long) p[1] << 16 | p[2]);
+               int h = mesh_hash (k) & (hashsize - 1);
+               while (hash[h] && key[h] != k)
+                  h = (h + 1) & (hashsize - 1);
+               if (!hash[h])
+               {
+                  key[h] = k;
+                  hash[h] = ++points;
+                  memcpy (q[points - 1], p, sizeof (p));
+                  for (int k = 0; k < 3; k++)
+                  {
+                     if (p[k] < qmin[k])
+                        qmin[k] = p[k];
+                     if (p[k] > qmax[k])
+                        qmax[k] = p[k];
+                  }
+               }
+               index[indexes++] = hash[h] - 1;
+            }
+      int wide = (points > 65535);      // 32 bit indices, 65535 is the primitive restart value glTF does not allow
+      size_t pointsat = binlen;
+      glb_put (&bin, &binlen, &binmax, q, (size_t) points * 8);
+      size_t indexat = binlen;
+      if (wide)
+         glb_put (&bin, &binlen, &binmax, index, (size_t) indexes * 4);
+      else
+         for (int i = 0; i < indexes; i++)
+         {
+            unsigned short i16 = index[i];
+            glb_put (&bin, &binlen, &binmax, &i16, 2);
+         }
+      glb_put (&bin, &binlen, &binmax, NULL, (4 - binlen % 4) % 4);
+      glb_printf (&v, "%s{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"byteStride\":8,\"target\":34962},",
+                  meshes ? "," : "", pointsat, (size_t) points * 8);
+      glb_printf (&v, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}", indexat,
+                  (size_t) indexes * (wide ? 4 : 2));
+      glb_printf (&a, "%s{\"bufferView\":%d,\"componentType\":5123,\"count\":%d,\"type\":\"VEC3\",\"min\":[%d,%d,%d],\"max\":[%d,%d,%d]},",
+                  meshes ? "," : "", meshes * 2, points, qmin[0], qmin[1], qmin[2], qmax[0], qmax[1], qmax[2]);
+      glb_printf (&a, "{\"bufferView\":%d,\"componentType\":%d,\"count\":%d,\"type\":\"SCALAR\"}", meshes * 2 + 1,
+                  wide ? 5125 : 5123, indexes);
+      glb_printf (&m, "%s{\"name\":\"Part %d\",\"primitives\":[{\"attributes\":{\"POSITION\":%d},\"indices\":%d,\"material\":%d}]}",
+                  meshes ? "," : "", part, meshes * 2, meshes * 2 + 1, meshes);
+      const float *rgb = palette[(part - 1) % (sizeof (palette) / sizeof (*palette))];
+      glb_printf (&c, "%s{\"pbrMetallicRoughness\":{\"baseColorFactor\":[%.2f,%.2f,%.2f,1],\"metallicFactor\":0,\"roughnessFactor\":0.7},\"doubleSided\":true}",
+                  meshes ? "," : "", rgb[0], rgb[1], rgb[2]);
+      glb_printf (&j, ",{\"name\":\"Part %d\",\"mesh\":%d,\"translation\":[%.6g,%.6g,%.6g],\"scale\":[%.9g,%.9g,%.9g]}", part, meshes,
+                  min[0], min[1], min[2], step[0], step[1], step[2]);
+      meshes++;
+      free (key);
+      free (hash);
+      free (index);
+      free (q);
+   }
+   glb_printf (&j, "],\"meshes\":[%s],\"materials\":[%s],\"accessors\":[%s],\"bufferViews\":[%s],\"buffers\":[{\"byteLength\":%zu}]}",
+               m.p ? : "", c.p ? : "", a.p ? : "", v.p ? : "", binlen);
+   free (a.p);
+   free (v.p);
+   free (m.p);
+   free (c.p);
+   while (j.len % 4)
+      glb_printf (&j, " ");     // Chunks are padded to 4 bytes
+                  // GLB is little endian, as are the hosts this is built for
+                  unsigned int header[5] = { 0x46546C67, 2, 12 + 8 + j.len + 8 + binlen, j.len, 0x4E4F534A };
+   unsigned int binheader[2] = { binlen, 0x004E4942 };
+   fwrite (header, 1, sizeof (header), f);
+   fwrite (j.p, 1, j.len, f);
+   fwrite (binheader, 1, sizeof (binheader), f);
+   fwrite (bin, 1, binlen, f);
+   free (j.p);
+   free (bin);
+   return ferror (f) ? "Write failed" : NULL;
+}
+
+#ifdef HAVE_FREETYPE
+// Native text, for --text-native - fonts found with fontconfig, glyph outlines flattened with FreeType
+// Flattened glyphs are cached by font, glyph and size, as the same letters and digits repeat across a box
+typedef struct
+{
+   char *key;                   // Font name, tab, character it was found for (0 for the font itself)
+   char *file;
+   int index;
+   FT_Face face;
+} text_font_t;
+
+typedef struct
+{
+   FT_Face face;
+   unsigned int glyph;
+   double size;                 // Em, mm
+   double advance;              // mm
+   int points;
+   double (*point)[2];          // mm
+   int contours;
+   int *contour;                // End of each contour
+} text_glyph_t;
+
+static FT_Library text_ft;
+static text_font_t *text_font;
+static int text_fonts;
+static text_glyph_t *text_glyph;
+static int text_glyphs,
+  text_glyphmax;
+static int *text_hash;          // Glyph number + 1
+static int text_hashsize;
+static double text_tolerance = 0.01;    // Max chord error for curves, mm
+
+static FT_Face
+text_face (const char *name, unsigned int c)
+{                               // Font from fontconfig by name, or if c, the best match that has character c, cached
+   char key[300];
+   snprintf (key, sizeof (key), "%s\t%X", name, c);
+   for (int i = 0; i < text_fonts; i++)
+      if (!strcmp (text_font[i].key, key))
+         return text_font[i].face;
+   if (!text_ft && (!FcInit () || FT_Init_FreeType (&text_ft)))
+      fatal ("Cannot start fontconfig and FreeType");
+   FcPattern *p = FcNameParse ((const FcChar8 *) name);
+   if (!p)
+      fatal ("Bad font name %s", name);
+   FcPatternAddBool (p, FC_OUTLINE, FcTrue);
+   if (c)
+   {
+      FcCharSet *cs = FcCharSetCreate ();
+      FcCharSetAddChar (cs, c);
+      FcPatternAddCharSet (p, FC_CHARSET, cs);
+      FcCharSetDestroy (cs);
+   }
+   FcConfigSubstitute (NULL, p, FcMatchPattern);
+   FcDefaultSubstitute (p);
+   FcResult res;
+   FcPattern *m = FcFontMatch (NULL, p, &res);
+   FcPatternDestroy (p);
+   FcChar8 *file = NULL;
+   int index = 0;
+   if (!m || FcPatternGetString (m, FC_FILE, 0, &file) != FcResultMatch)
+      fatal ("Cannot find font %s", name);
+   FcPatternGetInteger (m, FC_INDEX, 0, &index);
+   FT_Face face = NULL;
+   for (int i = 0; i < text_fonts && !face; i++)
+      if (text_font[i].index == index && !strcmp (text_font[i].file, (char *) file))
+         face = text_font[i].face;      // Same font found another way
+   if (!face && FT_New_Face (text_ft, (char *) file, index, &face))
+      fatal ("Cannot load font %s", file);
+   text_font = realloc (text_font, sizeof (*text_font) * (text_fonts + 1));
+   if (!text_font)
+      fatal ("Out of memory");
+   text_font[text_fonts].key = strdup (key);
+   text_font[text_fonts].file = strdup ((char *) file);
+   text_font[text_fonts].index = index;
+   text_font[text_fonts++].face = face;
+   FcPatternDestroy (m);
+   return face;
+}
+
+typedef struct
+{                               // Outline being flattened
+   text_glyph_t *g;
+   double scale;                // mm per font unit
+   double x,
+     y;                         // Current point, mm
+} text_flat_t;
+
+static void
+text_point (text_flat_t * f, double x, double y)
+{
+   text_glyph_t *g = f->g;
+   if (!(g->points & 63) && !(g->point = realloc (g->point, sizeof (*g->point) * (g->points + 64))))
+      fatal ("Out of memory");
+   g->point[g->points][0] = f->x = x;
+   g->point[g->points++][1] = f->y = y;
+}
+
+static void
+text_close (text_flat_t * f)
+{                               // End the contour, dropping a closing point that repeats the start
+   text_glyph_t *g = f->g;
+   int start = (g->contours ? g->contour[g->contours - 1] : 0);
+   if (g->points - start > 1 && g->point[g->points - 1][0] == g->point[start][0] && g->point[g->points - 1][1] == g->point[start][1])
+      g->points--;
+   if (g->points - start < 3)
+   {
+      g->points = start;        // Nothing
+      return;
+   }
+   if (!(g->contours & 15) && !(g->contour = realloc (g->contour, sizeof (*g->contour) * (g->contours + 16))))
+      fatal ("Out of memory");
+   g->contour[g->contours++] = g->points;
+}
+
+static int
+text_move (const FT_Vector * to, void *user)
+{
+   text_flat_t *f = user;
+   text_close (f);
+   text_point (f, to->x * f->scale, to->y * f->scale);
+   return 0;
+}
+
+static int
+text_line (const FT_Vector * to, void *user)
+{
+   text_flat_t *f = user;
+   text_point (f, to->x * f->scale, to->y * f->scale);
+   return 0;
+}
+
+static int
+text_curve (text_flat_t * f, int order, const double *x, const double *y)
+{                               // Bezier from the current point, order 2 or 3, enough steps for the tolerance
+   double dev = 0;
+   for (int i = 0; i + 2 <= order; i++)
+      dev = fmax (dev, hypot (x[i] - 2 * x[i + 1] + x[i + 2], y[i] - 2 * y[i + 1] + y[i + 2]));
+   int n = ceil (sqrt (dev * (order == 2 ? 0.25 : 0.75) / text_tolerance));
+   if (n < 1)
+      n = 1;
+   if (n > 64)
+      n = 64;
+   for (int s = 1; s <= n; s++)
+   {
+      double t = (double) s / n,
+         u = 1 - t;
+      if (order == 2)
+         text_point (f, u * u * x[0] + 2 * u * t * x[1] + t * t * x[2], u * u * y[0] + 2 * u * t * y[1] + t * t * y[2]);
+      else
+         text_point (f, u * u * u * x[0] + 3 * u * u * t * x[1] + 3 * u * t * t * x[2] + t * t * t * x[3],
+                     u * u * u * y[0] + 3 * u * u * t * y[1] + 3 * u * t * t * y[2] + t * t * t * y[3]);
+   }
+   return 0;
+}
+
+static int
+text_conic (const FT_Vector * c, const FT_Vector * to, void *user)
+{
+   text_flat_t *f = user;
+   double x[3] = { f->x, c->x * f->scale, to->x * f->scale },
+      y[3] = { f->y, c->y * f->scale, to->y * f->scale };
+   return text_curve (f, 2, x, y);
+}
+
+static int
+text_cubic (const FT_Vector * c1, const FT_Vector * c2, const FT_Vector * to, void *user)
+{
+   text_flat_t *f = user;
+   double x[4] = { f->x, c1->x * f->scale, c2->x * f->scale, to->x * f->scale },
+      y[4] = { f->y, c1->y * f->scale, c2->y * f->scale, to->y * f->scale };
+   return text_curve (f, 3, x, y);
+}
+
+static int
+text_glyph_get (FT_Face face, unsigned int glyph, double size)
+{                               // Flattened glyph, cached, returns its number in text_glyph
+   unsigned long long k = ((unsigned long long) (size_t) face * 31 + glyph) * 31 + llround (size * 1000);
+   if (text_hashsize)
+      for (int h = mesh_hash (k) & (text_hashsize - 1); text_hash[h]; h = (h + 1) & (text_hashsize - 1))
+      {
+         text_glyph_t *g = &text_glyph[text_hash[h] - 1];
+         if (g->face == face && g->glyph == glyph && g->size == size)
+            return text_hash[h] - 1;
       }
-      return 0;
-   case OPT_DOUBLE:
-      if (!value || parse_double (value, (double *) opt->target))
+   if (text_glyphs * 2 >= text_hashsize)
+   {                            // Grow and rehash
+      text_hashsize = (text_hashsize ? : 64) * 2;
+      free (text_hash);
+      if (!(text_hash = calloc (text_hashsize, sizeof (*text_hash))))
+         fatal ("Out of memory");
+      for (int i = 0; i < text_glyphs; i++)
       {
-         set_error (error, 256, "Invalid number for -%c", opt->short_name);
-         return -1;
+         text_glyph_t *g = &text_glyph[i];
+         int h = mesh_hash (((unsigned long long) (size_t) g->face * 31 + g->glyph) * 31 + llround (g->size * 1000)) & (text_hashsize - 1);
+         while (text_hash[h])
+            h = (h + 1) & (text_hashsize - 1);
+         text_hash[h] = i + 1;
       }
-      return 0;
-   case OPT_STRING:
-      if (!value)
+   }
+   if (text_glyphs == text_glyphmax && !(text_glyph = realloc (text_glyph, sizeof (*text_glyph) * (text_glyphmax += 64))))
+      fatal ("Out of memory");
+   text_glyph_t *g = &text_glyph[text_glyphs++];
+   memset (g, 0, sizeof (*g));
+   g->face = face;
+   g->glyph = glyph;
+   g->size = size;
+   text_flat_t f = {.g = g,.scale = size / face->units_per_EM };
+   if (!FT_Load_Glyph (face, glyph, FT_LOAD_NO_SCALE | FT_LOAD_NO_BITMAP) && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+   {
+      const FT_Outline_Funcs funcs = {.move_to = text_move,.line_to = text_line,.conic_to = text_conic,.cubic_to = text_cubic };
+      FT_Outline_Decompose (&face->glyph->outline, &funcs, &f);
+      text_close (&f);
+      g->advance = face->glyph->advance.x * f.scale;
+   }
+   int h = mesh_hash (k) & (text_hashsize - 1);
+   while (text_hash[h])
+      h = (h + 1) & (text_hashsize - 1);
+   text_hash[h] = text_glyphs;
+   return text_glyphs - 1;
+}
+
+static void
+text_polygon (const char *t, const char *font, double size)
+{                               // polygon() of text, centred, mm, sized as OpenSCAD text() (size in points at 100 DPI)
+   double em = size * 100 / 72;
+   FT_Face base = text_face (font ? : "Liberation Sans", 0);
+   int g[strlen (t) + 1];
+   double gx[strlen (t) + 1];
+   int n = 0;
+   double x = 0;
+   FT_Face last = NULL;
+   unsigned int lastglyph = 0;
+   while (*t)
+   {                            // UTF-8
+      unsigned int c = (unsigned char) *t++;
+      int more = (c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0);
+      if (more)
+         c &= (0x3F >> more);
+      while (more-- && (*t & 0xC0) == 0x80)
+         c = (c << 6) | (*t++ & 0x3F);
+      FT_Face face = base;
+      unsigned int glyph = FT_Get_Char_Index (face, c);
+      if (!glyph && c > ' ')
+      {                         // Another font that has it, e.g. emoji
+         face = text_face (font ? : "Liberation Sans", c);
+         glyph = FT_Get_Char_Index (face, c);
+      }
+      FT_Vector k;
+      if (face == last && FT_HAS_KERNING (face) && !FT_Get_Kerning (face, lastglyph, glyph, FT_KERNING_UNSCALED, &k))
+         x += k.x * em / face->units_per_EM;
+      g[n] = text_glyph_get (face, glyph, em);
+      gx[n] = x;
+      x += text_glyph[g[n++]].advance;
+      last = face;
+      lastglyph = glyph;
+   }
+   double miny = 1e30,
+      maxy = -1e30;
+   for (int i = 0; i < n; i++)
+      for (int p = 0; p < text_glyph[g[i]].points; p++)
       {
-         set_error (error, 256, "Missing value for -%c", opt->short_name);
-         return -1;
+         miny = fmin (miny, text_glyph[g[i]].point[p][1]);
+         maxy = fmax (maxy, text_glyph[g[i]].point[p][1]);
       }
+   if (miny > maxy)
+   {
+      printf ("union();\n");    // Nothing to see
+      return;
+   }
+   double dx = -x / 2,
+      dy = -(miny + maxy) / 2;  // halign and valign center
+   printf ("union(){");         // A polygon per glyph, as even-odd fill would make holes where glyphs overlap
+   for (int i = 0; i < n; i++)
+   {
+      const text_glyph_t *tg = &text_glyph[g[i]];
+      if (!tg->contours)
+         continue;
+      printf ("polygon(points=[");
+      for (int p = 0; p < tg->points; p++)
+         printf ("%s[%.3f,%.3f]", p ? "," : "", tg->point[p][0] + gx[i] + dx, tg->point[p][1] + dy);
+      printf ("],paths=[");
+      for (int c = 0; c < tg->contours; c++)
       {
-         char **target = (char **) opt->target;
-         free (*target);
-         *target = strdup (value);
-         if (!*target)
-         {
-            set_error (error, 256, "Out of memory");
-            return -1;
-         }
+         printf ("%s[", c ? "," : "");
+         for (int p = (c ? tg->contour[c - 1] : 0); p < tg->contour[c]; p++)
+            printf ("%s%d", p > (c ? tg->contour[c - 1] : 0) ? "," : "", p);
+         printf ("]");
       }
-      return 0;
+      printf ("]);");
    }
-   set_error (error, 256, "Unknown option type");
-   return -1;
-}
-
-static void
-fatal (const char *fmt, ...)
-{
-   va_list args;
-   va_start (args, fmt);
-   vfprintf (stderr, fmt, args);
-   va_end (args);
-   fputc ('\n', stderr);
-   exit (1);
+   printf ("}\n");
 }
+#endif
 
 int
 main (int argc, const char *argv[])
 {
+   double started = now_seconds ();
    double basethickness = 1.6;
    double basegap = 0.4;
    double baseheight = 10;
@@ -238,6 +3510,7 @@ main (int argc, const char *argv[])
    double textdepth = 0.5;
    double logodepth = 0.6;
    double gripdepth = 2;
+   double tolerance = 0;
    double textsidescale = 1;
    char *textinside = NULL;
    char *textend = NULL;
@@ -254,6 +3527,7 @@ main (int argc, const char *argv[])
    int nubs = helix;
    int logo = 0;
    int textslow = 0;
+   int preview = 0;
    int textoutset = 0;
    int symmectriccut = 0;
    int coresolid = 0;
@@ -261,9 +3535,42 @@ main (int argc, const char *argv[])
    int webform = 0;
    int parkvertical = 0;
    int mazecomplexity = 5;
+   int mazeslices = 4;
    int mirrorinside = 0;        // Clockwise lock on inside - may be unwise as more likely to come undone with outer.
    int noa = 0;
    int basewide = 0;
+   char *renderprefix = NULL;
+   int renderjobs = 0;
+   char *renderlog = NULL;
+   char *rendercost = NULL;
+   int plan = 0;
+   int analyse = 0;
+   int svg = 0;
+   int svgsolution = 0;
+   int glb = 0;
+   char *png = NULL;
+   char *pngsize = NULL;
+   int pngw = 640,
+      pngh = 480;
+   int library = 0;
+   int textnative = 0;
+   char *plateprefix = NULL;
+   char *bed = NULL;
+   char *plateadd = NULL;
+   char *platexy = NULL;
+   char *coupon = NULL;
+   int stress = 0;
+   int candidates = 0;
+   int timebudget = 0;
+   int threads = 0;
+   char *mazeout = NULL;
+   char *mazein = NULL;
+   int seed = 0;
+   char *fromid = NULL;
+   int gzip = 0;
+   int stats = 0;
+   char *trace = NULL;
+   int pipeline = 0;
 
    char pathsep = 0;
    char *path = getenv ("PATH_INFO");
@@ -292,6 +3599,7 @@ main (int argc, const char *argv[])
       {"maze-step", 'z', OPT_DOUBLE, &mazestep, "Maze spacing", "mm"},
       {"maze-margin", 'M', OPT_DOUBLE, &mazemargin, "Maze top margin", "mm"},
       {"maze-complexity", 'X', OPT_INT, &mazecomplexity, "Maze complexity", "-10 to 10"},
+      {"maze-slices", 0, OPT_INT, &mazeslices, "Slices per maze cell, 4 is the fewest (walls, floor, land), more for smoother large boxes", "N (4 or more)"},
       {"park-thickness", 'p', OPT_DOUBLE, &parkthickness, "Thickness of park ridge to click closed", "mm"},
       {"park-vertical", 'v', OPT_NONE, &parkvertical, "Park vertically", NULL},
       {"clearance", 'g', OPT_DOUBLE, &clearance, "General X/Y clearance", "mm"},
@@ -316,10 +3624,51 @@ main (int argc, const char *argv[])
       {"mime", 0, OPT_NONE, &mime, "MIME Header", NULL},
       {"no-a", 0, OPT_NONE, &noa, "No A", NULL},
       {"web-form", 0, OPT_NONE, &webform, "Web form", NULL},
+      {"analyse", 0, OPT_NONE, &analyse, "Report maze solution and statistics to stderr as JSON", NULL},
+      {"svg", 0, OPT_NONE, &svg, "SVG drawing of the mazes unrolled, instead of SCAD", NULL},
+      {"svg-solution", 0, OPT_NONE, &svgsolution, "Include the solution in the SVG", NULL},
+      {"glb", 0, OPT_NONE, &glb, "glTF binary of the parts for 3D preview, instead of SCAD", NULL},
+      {"png", 0, OPT_STRING, &png, "Also write a shaded picture of the parts to PNG file", "FILE"},
+      {"png-size", 0, OPT_STRING, &pngsize, "Size of PNG picture", "WxH (default 640x480)"},
+      {"candidates", 0, OPT_INT, &candidates, "Make N mazes per surface and keep the hardest", "N"},
+      {"time-budget", 0, OPT_INT, &timebudget, "Make candidate mazes for this long per surface and keep the hardest", "ms"},
+      {"threads", 0, OPT_INT, &threads, "Threads (default CPUs)", "N"},
+      {"maze-out", 0, OPT_STRING, &mazeout, "Save the mazes to file", "FILE"},
+      {"maze-in", 0, OPT_STRING, &mazein, "Use mazes saved with --maze-out (same options)", "FILE"},
+      {"seed", 0, OPT_INT, &seed, "Random seed (default from time)", "N"},
+      {"from-id", 0, OPT_STRING, &fromid, "Make box from box ID (other box options ignored)", "ID"},
+      {"gzip", 0, OPT_NONE, &gzip, "Compress output (gzip)", NULL},
+      {"pipeline", 0, OPT_NONE, &pipeline, "Write the output from a separate thread while it is made", NULL},
+      {"stats", 0, OPT_NONE, &stats, "Report timings and counts for each part and maze to stderr, as JSON", NULL},
+      {"trace", 0, OPT_STRING, &trace, "Write the timings as a Chrome trace event timeline", "FILE"},
+      {"preview", 0, OPT_NONE, &preview, "Quick to render preview: coarse curves, flat text, no logo, nubs merged", NULL},
+      {"tolerance", 0, OPT_DOUBLE, &tolerance, "Max chord error for curves (default fixed segments)", "mm"},
+      {"deterministic", 0, OPT_NONE, &deterministic, "Same output on every platform, trig from a table rather than libm", NULL},
+      {"check-mesh", 0, OPT_NONE, &checkmesh, "Check and clean each polyhedron, report to stderr", NULL},
+      {"library", 0, OPT_NONE, &library, "Mazes as data for puzzlebox.scad, smaller output", NULL},
+      {"text-native", 0, OPT_NONE, &textnative, "Text and logo as polygons made here rather than by OpenSCAD", NULL},
+      {"plate", 0, OPT_STRING, &plateprefix, "Pack the parts on to print beds, PREFIX-plate-N.scad (and .stl with --render)", "PREFIX"},
+      {"bed", 0, OPT_STRING, &bed, "Print bed size for --plate", "WxH (default 220x220)"},
+      {"plate-add", 0, OPT_STRING, &plateadd, "Other boxes to pack with this one for --plate", "ID{,ID...}"},
+      {"plate-xy", 0, OPT_STRING, &platexy, "Centre of the part made (with --part), as used by --plate", "X,Y"},
+      {"coupon", 0, OPT_STRING, &coupon, "Calibration coupons, a short box for each value, e.g. g=0.3,0.4,0.5/y=0,0.1",
+       "X=V{,V...}{/X=V...}"},
+      {"stress", 0, OPT_INT, &stress, "Make N boxes with random options, check each, and report the failures minimised, as JSON", "N"},
+      {"plan", 0, OPT_NONE, &plan, "Only report sizes and counts, as JSON", NULL},
+      {"render", 0, OPT_STRING, &renderprefix, "Render each part with openscad to PREFIX-part-N.stl", "PREFIX"},
+      {"render-jobs", 0, OPT_INT, &renderjobs, "Parallel openscad renders (default CPUs)", "N"},
+      {"render-log", 0, OPT_STRING, &renderlog, "Append render timings to file, and fit cost model", "FILE"},
+      {"render-cost", 0, OPT_STRING, &rendercost, "Render cost model: seconds per part, point, face", RENDER_COST},
       {NULL, 0, OPT_NONE, NULL, NULL, NULL}
    };
 
    char error[256] = {0};
+   int optioncount = 0;
+   while (optionsTable[optioncount].long_name)
+      optioncount++;
+   option_value_t defaults[optioncount];
+   for (int o = 0; o < optioncount; o++)
+      option_get (&optionsTable[o], &defaults[o]);
 
    for (int i = 1; i < argc; i++)
    {
@@ -482,6 +3831,29 @@ main (int argc, const char *argv[])
       }
    }
 
+   if (fromid)
+   {
+      unsigned int s;
+      int p = part;             // Part to make is kept, e.g. for plating
+      const char *e = box_from_id (optionsTable, defaults, fromid, &s);
+      if (e)
+      {
+         fprintf (stderr, "%s\n", e);
+         return 1;
+      }
+      seed = s;
+      if (p)
+         part = p;
+   }
+   if (candidates < 0)
+      fatal ("Bad candidates %d", candidates);
+   if (isnan (tolerance) || (tolerance > 0 && tolerance < TOLERANCE_MIN))
+      fatal ("Bad tolerance %g, the smallest is %g", tolerance, TOLERANCE_MIN);
+   if (!seed)
+      seed = ((unsigned int) time (NULL) ^ (unsigned int) clock ()) ? : 1;
+   rng_state = seed;
+   rng_seeded = 1;
+
    if (webform)
    {
       int o;
@@ -557,6 +3929,525 @@ main (int argc, const char *argv[])
       return 0;
    }
 
+   char *boxid = box_id (optionsTable, defaults, seed);  // Options as given, the same checks and adjustments follow from the ID
+
+   // Child runs of this for plating and coupons
+   const char *childarg[optioncount + 20];
+   char *childfree[optioncount + 20];
+   int childargs = 0,
+      childfrees = 0;
+   void child_arg (const char *fmt, ...)
+   {                            // Add an argument
+      char a[1000];
+      va_list ap;
+      va_start (ap, fmt);
+      vsnprintf (a, sizeof (a), fmt, ap);
+      va_end (ap);
+      if (!(childfree[childfrees] = strdup (a)))
+         fatal ("Out of memory");
+      childarg[childargs++] = childfree[childfrees++];
+   }
+   void child_options (int all)
+   {                            // Add options not at default, all or only those not in a box ID, except those for output or plating
+      const char *exclude[] = { "from-id", "seed", "part", "plate", "bed", "plate-add", "plate-xy", "coupon", "stress", "plan", "mime", "web-form",
+         "gzip", "analyse", "svg", "svg-solution", "glb", "png", "png-size", "library", "maze-out", "render", "render-jobs", "render-log",
+         "render-cost", "stats", "trace", "pipeline", NULL
+      };
+      for (int o = 0; o < optioncount; o++)
+      {
+         const option_t *opt = &optionsTable[o];
+         int e = 0;
+         while (exclude[e] && strcmp (exclude[e], opt->long_name))
+            e++;
+         if (exclude[e] || (!all && id_key (opt)) || option_is (opt, &defaults[o]))
+            continue;
+         if (opt->type == OPT_NONE)
+            child_arg ("--%s", opt->long_name);
+         else if (opt->type == OPT_INT)
+            child_arg ("--%s=%d", opt->long_name, *(int *) opt->target);
+         else if (opt->type == OPT_DOUBLE)
+            child_arg ("--%s=%.17g", opt->long_name, *(double *) opt->target);
+         else
+            child_arg ("--%s=%s", opt->long_name, *(char **) opt->target);
+      }
+   }
+   void child_free (void)
+   {
+      while (childfrees)
+         free (childfree[--childfrees]);
+      childargs = 0;
+   }
+   double bedw = 220,
+      bedh = 220;
+   if (bed && (sscanf (bed, "%lfx%lf", &bedw, &bedh) != 2 || bedw <= 0 || bedh <= 0))
+      fatal ("Bad bed size %s", bed);
+
+   if (plateprefix)
+   {                            // Plating - each box is planned and each part made by a child run, from its box ID
+      if (timebudget)
+         fatal ("Boxes made with --time-budget cannot be remade for plating");
+      double model[3];
+      if (render_model (rendercost ? : RENDER_COST, model))
+         fatal ("Bad render cost model [%s]", rendercost);
+      // Child arguments - box ID, then the options not in a box ID
+      const char **args = childarg;
+      child_arg ("%s", argv[0]);
+      child_arg ("--from-id");
+      child_arg ("");           // ID
+      child_options (0);
+      int base = childargs;
+      // Boxes, then their parts
+      char *ids = malloc (strlen (boxid) + (plateadd ? strlen (plateadd) : 0) + 2);
+      if (!ids)
+         fatal ("Out of memory");
+      sprintf (ids, "%s%s%s", boxid, plateadd ? "," : "", plateadd ? : "");
+      char *id[strlen (ids) / 2 + 1];
+      int boxes = 0;
+      for (char *p = strtok (ids, ","); p; p = strtok (NULL, ","))
+         id[boxes++] = p;
+      plate_item_t *item = NULL;
+      int count = 0;
+      for (int b = 0; b < boxes; b++)
+      {
+         FILE *t = tmpfile ();
+         if (!t)
+            fatal ("Cannot make temporary file");
+         args[2] = id[b];
+         args[base] = "--plan";
+         args[base + 1] = NULL;
+         if (plate_child (main, base + 1, args, t))
+            fatal ("Cannot plan box %s", id[b]);
+         size_t len = ftell (t);
+         char *json = malloc (len + 1);
+         rewind (t);
+         if (!json || fread (json, 1, len, t) != len)
+            fatal ("Cannot read plan for box %s", id[b]);
+         json[len] = 0;
+         fclose (t);
+         for (char *p = strstr (json, "{\"part\":"); p; p = strstr (p + 1, "{\"part\":"))
+         {
+            plate_item_t i = {.box = b + 1 };
+            double r2,
+              r3;
+            char *pts = strstr (p, "],\"points\":");
+            if (sscanf (p, "{\"part\":%d,\"r0\":%*f,\"r1\":%*f,\"r2\":%lf,\"r3\":%lf", &i.part, &r2, &r3) != 3 || !pts
+                || sscanf (pts, "],\"points\":%lld,\"faces\":%lld", &i.points, &i.faces) != 2)
+               fatal ("Cannot read plan for box %s", id[b]);
+            i.r = (r2 > r3 ? r2 : r3);  // Polygon corners
+            if (!(item = realloc (item, sizeof (*item) * (count + 1))))
+               fatal ("Out of memory");
+            item[count++] = i;
+         }
+         free (json);
+      }
+      int plates = plate_pack (item, count, bedw, bedh, 5);
+      render_job_t jobs[plates];
+      for (int p = 0; p < plates; p++)
+      {
+         render_job_t *j = &jobs[p];
+         memset (j, 0, sizeof (*j));
+         j->part = p + 1;
+         render_names (j, plateprefix, "plate", p + 1);
+         FILE *f = fopen (j->scad, "w");
+         if (!f)
+            fatal ("Cannot write %s", j->scad);
+         fprintf (f, "// Plate %d of %d, bed %gx%g\n", p + 1, plates, bedw, bedh);
+         for (int n = 0; n < count; n++)
+            if (item[n].plate == p)
+            {                   // Each part in its own module, as each has its own modules
+               char part[20],
+                 xy[50];
+               snprintf (part, sizeof (part), "--part=%d", item[n].part);
+               snprintf (xy, sizeof (xy), "--plate-xy=%.3f,%.3f", item[n].x, item[n].y);
+               args[2] = id[item[n].box - 1];
+               args[base] = part;
+               args[base + 1] = xy;
+               args[base + 2] = NULL;
+               fprintf (f, "// Box %s part %d\nmodule box%d_part%d(){\n", id[item[n].box - 1], item[n].part, item[n].box, item[n].part);
+               if (plate_child (main, base + 2, args, f))
+                  fatal ("Cannot make box %s part %d", id[item[n].box - 1], item[n].part);
+               fprintf (f, "}\nbox%d_part%d();\n", item[n].box, item[n].part);
+               j->points += item[n].points;
+               j->faces += item[n].faces;
+            }
+         if (fclose (f))
+            fatal ("Cannot write %s", j->scad);
+         j->cost = model[0] + model[1] * j->points + model[2] * j->faces;
+      }
+      child_free ();
+      free (item);
+      free (ids);
+      if (renderprefix)
+         return render_parts (jobs, plates, renderjobs, renderlog);
+      return 0;
+   }
+
+   if (coupon)
+   {                            // Calibration coupons - a two part box, only a few maze rows high, for each combination of values, on one plate
+      const option_t *axis[2] = { NULL };
+      double value[2][20];
+      int values[2] = { 1, 1 },
+         axes = 0;
+      for (const char *a = coupon; *a;)
+      {                         // Option=values, up to two separated by /
+         const char *v = strchr (a, '=');
+         if (axes == 2 || !v || v == a)
+            fatal ("Bad coupon values %s", coupon);
+         char name[64];
+         snprintf (name, sizeof (name), "%.*s", (int) (v - a), a);
+         const option_t *o = (name[1] ? find_option_by_long (optionsTable, name) : find_option_by_short (optionsTable, *name));
+         if (!o || o->type != OPT_DOUBLE)
+            fatal ("Coupon option %s is not a size", name);
+         axis[axes] = o;
+         values[axes] = 0;
+         for (v++;;)
+         {
+            char *e;
+            double d = strtod (v, &e);
+            if (e == v || values[axes] == sizeof (value[0]) / sizeof (*value[0]))
+               fatal ("Bad coupon values %s", coupon);
+            value[axes][values[axes]++] = d;
+            v = e;
+            if (*v != ',')
+               break;
+            v++;
+         }
+         if (*v && *v != '/')
+            fatal ("Bad coupon values %s", coupon);
+         a = (*v ? v + 1 : v);
+         axes++;
+      }
+      void args (int cell)
+      {                         // Child arguments for a coupon
+         child_free ();
+         child_arg ("%s", argv[0]);
+         child_options (1);
+         child_arg ("--seed=%u", seed);
+         child_arg ("--parts=2");
+         child_arg ("--core-height=%.17g", mazestep * (helix + 2));     // Entry, a row, and the park
+         child_arg ("--base-height=%.17g", mazestep);
+         child_arg ("--text-end=%d\\%d", cell + 1, cell + 1);
+         for (int a = 0; a < axes; a++)
+            child_arg ("--%s=%.17g", axis[a]->long_name, value[a][a ? cell % values[1] : cell / values[1]]);
+      }
+      int cells = values[0] * values[1];
+      plate_item_t item[cells * 2];
+      int count = 0;
+      for (int c = 0; c < cells; c++)
+      {
+         FILE *t = tmpfile ();
+         if (!t)
+            fatal ("Cannot make temporary file");
+         args (c);
+         child_arg ("--plan");
+         childarg[childargs] = NULL;
+         if (plate_child (main, childargs, childarg, t))
+            fatal ("Cannot make coupon %d", c + 1);
+         char json[10000];
+         rewind (t);
+         json[fread (json, 1, sizeof (json) - 1, t)] = 0;
+         fclose (t);
+         for (char *p = strstr (json, "{\"part\":"); p && count < cells * 2; p = strstr (p + 1, "{\"part\":"))
+         {
+            plate_item_t i = {.box = c + 1 };
+            double r2,
+              r3;
+            if (sscanf (p, "{\"part\":%d,\"r0\":%*f,\"r1\":%*f,\"r2\":%lf,\"r3\":%lf", &i.part, &r2, &r3) != 3)
+               fatal ("Cannot read plan for coupon %d", c + 1);
+            i.r = (r2 > r3 ? r2 : r3);
+            item[count++] = i;
+         }
+      }
+      if (plate_pack (item, count, bedw, bedh, 5) > 1)
+         fatal ("Coupons do not fit the bed, try fewer values or a larger --bed");
+      printf ("// Calibration coupons, bed %gx%g, the maze part and lid of each are marked with its number\n", bedw, bedh);
+      for (int c = 0; c < cells; c++)
+      {
+         printf ("// Coupon %d:", c + 1);
+         for (int a = 0; a < axes; a++)
+            printf (" %s=%g", axis[a]->long_name, value[a][a ? c % values[1] : c / values[1]]);
+         printf ("\n");
+      }
+      for (int n = 0; n < count; n++)
+      {
+         args (item[n].box - 1);
+         child_arg ("--part=%d", item[n].part);
+         child_arg ("--plate-xy=%.3f,%.3f", item[n].x, item[n].y);
+         childarg[childargs] = NULL;
+         printf ("module coupon%d_part%d(){\n", item[n].box, item[n].part);
+         if (plate_child (main, childargs, childarg, stdout))
+            fatal ("Cannot make coupon %d", item[n].box);
+         printf ("}\ncoupon%d_part%d();\n", item[n].box, item[n].part);
+      }
+      child_free ();
+      return 0;
+   }
+
+   if (stress > 0)
+   {                            // Stress test - boxes with random options, each made and checked in a child, failures minimised
+#ifdef _WIN32
+      fatal ("Stress test not supported on this platform");
+#else
+      typedef struct
+      {                         // A test case
+         int args,
+           fixed;               // Arguments, and where those given with --stress start
+         char arg[60][64];
+         pid_t pid;
+         FILE *err;             // Its stderr
+      } stress_t;
+      unsigned int rng = seed;
+      void add (stress_t * c, const char *fmt, ...)
+      {
+         va_list ap;
+         va_start (ap, fmt);
+         if (c->args < (int) (sizeof (c->arg) / sizeof (*c->arg)))
+            vsnprintf (c->arg[c->args++], sizeof (*c->arg), fmt, ap);
+         va_end (ap);
+      }
+      int pick (int n)
+      {
+         return random_int_r (&rng, n);
+      }
+      double range (double lo, double hi, double step)
+      {
+         return lo + step * pick ((hi - lo) / step + 1.5);
+      }
+      void sample (stress_t * c)
+      {                         // Random options, in the ranges people use, then those given
+         c->args = 0;
+         add (c, "%s", argv[0]);
+         add (c, "--seed=%d", pick (32767) + 1);
+         add (c, "--check-mesh");
+         add (c, "--parts=%d", 2 + pick (5));
+         add (c, "--helix=%d", pick (5));
+         add (c, "--nubs=%d", 1 + pick (4));
+         const char *flag[] = { "inside", "flip", "base-wide", "park-vertical", "core-solid", "symmetric-cut", "no-a" };
+         for (int f = 0; f < (int) (sizeof (flag) / sizeof (*flag)); f++)
+            if (!pick (4))
+               add (c, "--%s", flag[f]);
+         add (c, "--outer-sides=%d", pick (3) ? 3 + pick (10) : 0);
+         add (c, "--core-diameter=%g", range (5, 50, 0.5));
+         add (c, "--core-height=%g", range (10, 100, 1));
+         if (!pick (3))
+            add (c, "--core-gap=%g", range (0, 20, 1));
+         add (c, "--base-height=%g", range (4, 15, 0.5));
+         add (c, "--base-thickness=%g", range (1, 3, 0.1));
+         add (c, "--base-gap=%g", range (0.2, 0.8, 0.05));
+         add (c, "--part-thickness=%g", range (0.8, 2.5, 0.1));
+         add (c, "--maze-thickness=%g", range (1, 3, 0.1));
+         add (c, "--maze-step=%g", range (1.5, 5, 0.1));
+         add (c, "--maze-margin=%g", range (0, 2, 0.1));
+         add (c, "--maze-complexity=%d", pick (21) - 10);
+         if (!pick (3))
+            add (c, "--maze-slices=%d", 4 + pick (5));
+         add (c, "--clearance=%g", range (0.1, 0.6, 0.05));
+         add (c, "--nub-r-clearance=%g", range (-0.1, 0.3, 0.05));
+         add (c, "--nub-z-clearance=%g", range (0, 0.4, 0.05));
+         add (c, "--park-thickness=%g", range (0, 1.2, 0.1));
+         add (c, "--outer-round=%g", range (0, 3, 0.5));
+         if (!pick (3))
+            add (c, "--tolerance=%g", range (0.01, 0.3, 0.01));
+         c->fixed = c->args;
+         for (int a = 0; a < childargs; a++)
+            add (c, "%s", childarg[a]);
+      }
+      int argp (stress_t * c, const char **v)
+      {
+         for (int a = 0; a < c->args; a++)
+            v[a] = c->arg[a];
+         v[c->args] = NULL;
+         return c->args;
+      }
+      int valid (stress_t * c)
+      {                         // Planned here, as the sizes are checked without making anything
+         const char *v[c->args + 2];
+         int n = argp (c, v);
+         v[n++] = "--plan";
+         v[n] = NULL;
+         char *json = NULL;
+         size_t len = 0;
+         FILE *keep = stdout;
+         if (!(stdout = open_memstream (&json, &len)))
+            fatal ("Cannot capture plan");
+         int e = main (n, v);
+         fclose (stdout);
+         stdout = keep;
+         e = (e || !json || strstr (json, "\"error\""));
+         free (json);
+         return !e;
+      }
+      void start (stress_t * c)
+      {                         // Make the box in a child, output discarded, stderr kept
+         if (!(c->err = tmpfile ()))
+            fatal ("Cannot make temporary file");
+         fflush (stdout);
+         fflush (stderr);
+         if ((c->pid = fork ()) < 0)
+            fatal ("Cannot fork");
+         if (!c->pid)
+         {
+            unsetenv ("PATH_INFO");     // Arguments only
+            unsetenv ("QUERY_STRING");
+            dup2 (fileno (c->err), 2);
+            if (!(stdout = fopen ("/dev/null", "w")))
+               _exit (1);
+            alarm (60);         // Hung
+            const char *v[c->args + 1];
+            int r = main (argp (c, v), v);
+            fflush (stdout);
+            fflush (stderr);
+            _exit (r);
+         }
+      }
+      int failure (stress_t * c, int status, char *why, size_t size)
+      {                         // Why it failed, numbers taken out so the same fault compares the same, else 0
+         char line[1000],
+           last[1000] = "";
+         *why = 0;
+         rewind (c->err);
+         while (fgets (line, sizeof (line), c->err) && !*why)
+         {
+            char *e = strstr (line, " - FAILED");
+            if (e && (e = strchr (line, ':')))
+               snprintf (why, size, "Mesh check failed, %.*s", (int) (e - line), line);
+            else if (*line != '\n')
+               strcpy (last, line);
+         }
+         fclose (c->err);
+         c->err = NULL;
+         if (!*why && WIFSIGNALED (status))
+            snprintf (why, size, WTERMSIG (status) == SIGALRM ? "Timeout" : "Signal %d", WTERMSIG (status));
+         else if (!*why && (!WIFEXITED (status) || WEXITSTATUS (status)))
+            snprintf (why, size, "%s", *last ? last : "Failed");
+         char *o = why;
+         for (char *i = why; *i; i++)
+            if (isdigit (*i))
+            {
+               if (o == why || o[-1] != 'N')
+                  *o++ = 'N';
+            } else if (*i != '\n' && *i != '"' && *i != '\\')
+               *o++ = *i;
+         *o = 0;
+         return *why != 0;
+      }
+      int check (stress_t * c, char *why, size_t size)
+      {
+         start (c);
+         int status;
+         while (waitpid (c->pid, &status, 0) < 0)
+            if (errno != EINTR)
+               fatal ("Cannot wait");
+         return failure (c, status, why, size);
+      }
+      childargs = 0;
+      child_options (1);        // Options given with --stress apply to every case
+      int slots = (threads > 0 ? threads : cpus ());
+      stress_t *run = calloc (slots, sizeof (*run));
+      typedef struct
+      {                         // A distinct failure
+         char why[200];
+         int cases;
+         stress_t first;
+      } fault_t;
+      fault_t *fault = NULL;
+      int faults = 0,
+         made = 0,
+         done = 0,
+         running = 0,
+         invalid = 0,
+         failed = 0;
+      double t0 = now_seconds ();
+      if (!run)
+         fatal ("Out of memory");
+      while (made < stress || running)
+      {
+         for (int s = 0; s < slots && made < stress; s++)
+            if (!run[s].pid)
+            {
+               int tries = 0;
+               do
+               {
+                  if (++tries > 1000)
+                     fatal ("Cannot find valid options");
+                  sample (&run[s]);
+               }
+               while (!valid (&run[s]) && ++invalid);
+               start (&run[s]);
+               made++;
+               running++;
+            }
+         int status;
+         pid_t pid = waitpid (-1, &status, 0);
+         if (pid < 0)
+         {
+            if (errno == EINTR)
+               continue;
+            fatal ("Cannot wait");
+         }
+         for (int s = 0; s < slots; s++)
+            if (run[s].pid == pid)
+            {
+               char why[200];
+               running--;
+               done++;
+               run[s].pid = 0;
+               if (failure (&run[s], status, why, sizeof (why)))
+               {
+                  failed++;
+                  int f;
+                  for (f = 0; f < faults && strcmp (fault[f].why, why); f++);
+                  if (f == faults)
+                  {
+                     if (!(fault = realloc (fault, sizeof (*fault) * (faults + 1))))
+                        fatal ("Out of memory");
+                     memset (&fault[f], 0, sizeof (*fault));
+                     snprintf (fault[f].why, sizeof (fault[f].why), "%s", why);
+                     fault[f].first = run[s];
+                     faults++;
+                     fprintf (stderr, "New failure: %s\n", why);
+                  }
+                  fault[f].cases++;
+               }
+            }
+         if (!(done % 100))
+            fprintf (stderr, "%d/%d cases, %d failed\n", done, stress, failed);
+      }
+      free (run);
+      for (int f = 0; f < faults; f++)
+      {                         // Minimise, removing each random option while it still fails the same way
+         stress_t *m = &fault[f].first;
+         for (int changed = 1; changed;)
+         {
+            changed = 0;
+            for (int a = 3; a < m->fixed; a++)
+            {
+               stress_t t = *m;
+               memmove (t.arg[a], t.arg[a + 1], sizeof (*t.arg) * (t.args - a - 1));
+               t.args--;
+               t.fixed--;
+               char why[200];
+               if (check (&t, why, sizeof (why)) && !strcmp (why, fault[f].why))
+               {
+                  *m = t;
+                  changed = 1;
+                  a--;
+               }
+            }
+         }
+         printf ("{\"failure\":\"%s\",\"cases\":%d,\"args\":\"", fault[f].why, fault[f].cases);
+         for (int a = 1; a < m->args; a++)
+            printf ("%s%s", a > 1 ? " " : "", m->arg[a]);
+         printf ("\"}\n");
+      }
+      printf ("{\"cases\":%d,\"invalid\":%d,\"failed\":%d,\"faults\":%d,\"seconds\":%.1f}\n", made, invalid, failed, faults,
+              now_seconds () - t0);
+      free (fault);
+      child_free ();
+      return failed ? 1 : 0;
+#endif
+   }
+
 // Sanity checks and adjustments
    char *normalise (char *t)
    {                            // Simple text normalise
@@ -571,110 +4462,495 @@ main (int argc, const char *argv[])
       }
       return text;
    }
-   textend = normalise (textend);
-   textsides = normalise (textsides);
-   textinside = normalise (textinside);
-   if (!outersides)
-      textsides = NULL;
-   if (textfont && !*textfont)
-      textfont = NULL;
-   if (textfont && !textfontend)
-      textfontend = textfont;
-   if (textend && !*textend)
-      textend = NULL;
-   if (textinside && !*textinside)
-      textinside = NULL;
-   if (textsides && !*textsides)
+   textend = normalise (textend);
+   textsides = normalise (textsides);
+   textinside = normalise (textinside);
+   if (!outersides)
+      textsides = NULL;
+   if (textfont && !*textfont)
+      textfont = NULL;
+   if (textfont && !textfontend)
+      textfontend = textfont;
+   if (textend && !*textend)
+      textend = NULL;
+   if (textinside && !*textinside)
+      textinside = NULL;
+   if (textsides && !*textsides)
+   {
+      textsidescale = 0;
+      textsides = NULL;
+   }
+   if (helix && nubs > 1 && nubs < helix)
+   {
+      if (!(helix % 2) && nubs <= helix / 2)
+         nubs = helix / 2;
+      else
+         nubs = helix;
+   }
+   if (helix && nubs > helix)
+      nubs = helix;
+   if (gripdepth > (baseheight - outerround) / 6)
+      gripdepth = (baseheight - outerround) / 6;
+   if (gripdepth > mazethickness)
+      gripdepth = mazethickness;
+   if (!logo && !textinside)
+      logodepth = 0;
+   if (!textsides && !textend && !textinside)
+      textdepth = 0;
+   if (coresolid && coregap < mazestep * 2)
+      coregap = mazestep * 2;
+   if (nubs < 1)
+      nubs = 1;
+   if (glb)
+      svg = svgsolution = library = 0;  // The SCAD is not kept
+   if (svgsolution)
+      svg = 1;
+   if (svg || glb)
+      renderprefix = NULL;      // Drawing only
+   double platex = 0,
+      platey = 0;
+   if (platexy && sscanf (platexy, "%lf,%lf", &platex, &platey) != 2)
+      fatal ("Bad part centre %s", platexy);
+   if (pngsize && (sscanf (pngsize, "%dx%d", &pngw, &pngh) != 2 || pngw < 16 || pngh < 16 || pngw > 8192 || pngh > 8192))
+      fatal ("Bad PNG size %s", pngsize);
+   if (preview)
+   {                            // Only what is needed to judge the maze and proportions
+      textslow = 0;
+      logo = 0;                 // Keeping logodepth so sizes are the same
+      if (tolerance <= 0)
+         tolerance = 0.2;
+   }
+   if (mazeslices < 4)
+      mazeslices = 4;           // Left wall, floor, right wall, join
+   int floorslices = 1 + (mazeslices - 3) / 2;  // Slices across the groove floor, the rest go on the land to the next cell
+   double slicepos (int S)
+   {                            // Position of slice S in quarter cells, walls stay put, extra slices split floor and land
+      int X = S / mazeslices,
+         j = S % mazeslices;
+      if (j <= 1)
+         return X * 4 + j;
+      if (j <= floorslices + 1)
+         return X * 4 + 1 + (double) (j - 1) / floorslices;
+      return X * 4 + 3 + (double) (j - floorslices - 2) / (mazeslices - floorslices - 2);
+   }
+#ifdef HAVE_FREETYPE
+   if (tolerance > 0)
+      text_tolerance = tolerance;
+#else
+   if (textnative && (textend || textsides || textinside))
+      fatal ("Native text needs building with FreeType and fontconfig");
+#endif
+
+   int markpos0 = (outersides && outersides / nubs * nubs != outersides);       // Mark on position zero for alignment
+   double nubskew = (symmectriccut ? 0 : mazestep / 8); // Skew the shape of the cut
+
+   typedef struct
+   {                            // Part dimensions
+      int mazeinside;           // This part has maze inside
+      int mazeoutside;          // This part has maze outside
+      int nextinside;           // Next part has maze inside
+      int nextoutside;          // Next part has maze outside
+      int W;                    // Default maze width
+      // r0 is inside of part+maze
+      // r1 is outside of part+maze
+      // r2 is outside of base before "sides" adjust
+      // r3 is outside of base with "sides" adjust
+      double r0,
+        r1,
+        r2,
+        r3;
+      double height;
+   } part_t;
+   void sizepart (int part, part_t * d)
+   {                            // Dimensions of a part
+      d->mazeinside = inside;
+      d->mazeoutside = !inside;
+      d->nextinside = inside;
+      d->nextoutside = !inside;
+      if (flip)
+      {
+         if (part & 1)
+         {
+            d->mazeinside = 1 - d->mazeinside;
+            d->nextoutside = 1 - d->nextoutside;
+         } else
+         {
+            d->mazeoutside = 1 - d->mazeoutside;
+            d->nextinside = 1 - d->nextinside;
+         }
+      }
+      if (part == 1)
+         d->mazeinside = 0;
+      if (part == parts)
+         d->mazeoutside = 0;
+      if (part + 1 >= parts)
+         d->nextoutside = 0;
+      if (part == parts)
+         d->nextinside = 0;
+      double r1 = corediameter / 2 + wallthickness + (part - 1) * (wallthickness + mazethickness + clearance);  // Outer
+      if (coresolid)
+         r1 -= wallthickness + mazethickness + clearance - (inside ? mazethickness : 0);        // Adjust to make part 2 the core diameter
+      d->W = ((int) (r1 * 2 * M_PI / mazestep)) / nubs * nubs;  // Default value
+      double r0 = r1 - wallthickness;   // Inner
+      if (d->mazeinside && part > 1)
+         r0 -= mazethickness;   // Maze on inside
+      if (d->mazeoutside && part < parts)
+         r1 += mazethickness;   // Maze on outside
+      double r2 = r1;           // Base outer
+      if (part < parts)
+         r2 += clearance;
+      if (part + 1 >= parts && textsides && !textoutset)
+         r2 += textdepth;
+      if (d->nextinside)
+         r2 += mazethickness;
+      if (d->nextoutside || part + 1 == parts)
+         r2 += wallthickness;
+      if (basewide && part + 1 < parts)
+         r2 += d->nextoutside ? mazethickness : wallthickness;
+      double r3 = r2;
+      if (outersides && part + 1 >= parts)
+         r3 /= (deterministic ? trig_cos (0.5 / outersides) : cos ((double) M_PI / outersides));  // Bigger because of number of sides
+      double height = (coresolid ? coregap + baseheight : 0) + coreheight + basethickness + (basethickness + basegap) * (part - 1);
+      if (part == 1)
+         height -= (coresolid ? coreheight : coregap);
+      if (part > 1)
+         height -= baseheight;  // base from previous unit is added to this
+      d->r0 = r0;
+      d->r1 = r1;
+      d->r2 = r2;
+      d->r3 = r3;
+      d->height = height;
+   }
+   int segments (double r, int n)
+   {                            // Segments for a circle of radius r within the tolerance, else n
+      if (tolerance <= 0 || r <= 0)
+         return n;
+      if (tolerance >= r)
+         return 3;
+      if (deterministic)
+      {                         // Fewest segments with cos(pi/n) >= 1-tolerance/r, by bisection
+         int lo = 3,
+            hi = 3;
+         while (hi < SEGMENTS_MAX && trig_cos (0.5 / hi) < 1 - tolerance / r)
+            lo = hi + 1, hi *= 2;
+         while (lo < hi)
+         {
+            n = (lo + hi) / 2;
+            if (trig_cos (0.5 / n) < 1 - tolerance / r)
+               lo = n + 1;
+            else
+               hi = n;
+         }
+         return hi > SEGMENTS_MAX ? SEGMENTS_MAX : hi;
+      }
+      double f = ceil (M_PI / acos (1 - tolerance / r));
+      return f < 3 ? 3 : f > SEGMENTS_MAX ? SEGMENTS_MAX : (int) f;
+   }
+   int roundn;                  // Segments for a round outer, the last part being largest
+   int logon;                   // Segments for the logo circles
+   {
+      part_t d;
+      sizepart (parts, &d);
+      roundn = segments (d.r2, 100);
+      logon = segments (d.r0 * 0.9, 100);
+   }
+   typedef struct
+   {                            // Maze surface dimensions
+      int W,
+        H;                      // H includes one above, one below and helix below
+      double base;              // Bottom of maze
+      double y0;                // Centre of row 0
+      double dy;                // Helix rise per X
+      int a;                    // Room for the "A" at the park point
+   } mazesize_t;
+   const char *sizemaze (int part, double height, double r, int inside, mazesize_t * m)
+   {                            // Dimensions of a maze surface, returns error or NULL
+      m->W = ((int) ((r + (inside ? mazethickness : -mazethickness)) * 2 * M_PI / mazestep)) / nubs * nubs;   // Update W for actual maze
+      double base = (inside ? basethickness : baseheight);
+      if (inside && part > 2)
+         base += baseheight;    // Nubs don't go all the way to the end
+      if (inside && part == 2)
+         base += (coresolid ? coreheight : coregap);    // First one is short...
+      if (inside)
+         base += basegap;
+      double h = height - base - mazemargin - (parkvertical ? mazestep / 4 : 0) - mazestep / 8;
+      m->H = (int) (h / mazestep);
+      m->base = base;
+      m->y0 = base + mazestep / 2 - mazestep * (helix + 1) + mazestep / 8;
+      m->H += 2 + helix;        // Allow one above, one below and helix below
+      m->dy = 0;
+      if (helix)
+         m->dy = mazestep * helix / m->W;
+      if (parkvertical)
+         m->a = (!inside && !noa && m->W / nubs > 2 && m->H > helix + 4);
+      else
+         m->a = (!inside && !noa && m->W / nubs > 3 && m->H > helix + 3);
+      if (m->W < 3 || m->H < 1)
+         return "Too small";
+      return NULL;
+   }
+
+   long long mazecells (mazesize_t * m, double height)
+   {                            // Usable maze locations, i.e. those test() finds valid, all of which the maze visits
+      long long cells = 0;
+      int valid (int Y, int X)
+      {                         // Same as the too high/low clearing in makemaze
+         return !(mazestep * Y + m->y0 + m->dy * X < m->base + mazestep / 2 + mazestep / 8
+                  || mazestep * Y + m->y0 + m->dy * X > height - mazestep / 2 - mazemargin - mazestep / 8);
+      }
+      for (int X = 0; X < m->W; X++)
+      {
+         int lo = 0,
+            hi = m->H - 1,
+            x = X,
+            c = 0;              // Row offset of this nub copy
+         for (int n = 0; n < nubs && lo <= hi; n++)
+         {
+            double z = m->y0 + m->dy * x;
+            int a = ceil ((m->base + mazestep / 2 + mazestep / 8 - z) / mazestep),
+               b = floor ((height - mazestep / 2 - mazemargin - mazestep / 8 - z) / mazestep);
+            if (a < 0)
+               a = 0;
+            if (b > m->H - 1)
+               b = m->H - 1;
+            while (a > 0 && valid (a - 1, x))
+               a--;
+            while (a <= b && !valid (a, x))
+               a++;
+            while (b < m->H - 1 && valid (b + 1, x))
+               b++;
+            while (b >= a && !valid (b, x))
+               b--;
+            if (a - c > lo)
+               lo = a - c;
+            if (b - c < hi)
+               hi = b - c;
+            x += m->W / nubs;
+            while (x >= m->W)
+            {
+               x -= m->W;
+               c += helix;
+            }
+            if (helix == nubs)
+               c--;
+         }
+         if (hi >= lo)
+            cells += hi - lo + 1;
+      }
+      return cells;
+   }
+   if (plan)
+   {                            // Sizes and counts only, as JSON
+      basethickness += logodepth;
+      const char *e = NULL;
+      if (parts < 1 || parts > 100)
+         e = "Bad parts";
+      else if (part < 0 || part > parts)
+         e = "Bad part";
+      else if (helix < 0 || helix > 100 || nubs > 100)
+         e = "Bad helix or nubs";
+      else if (!(mazestep > 0.1) || !(mazethickness > 0) || !(wallthickness > 0))
+         e = "Bad maze step or thickness";
+      else if (!(corediameter >= 0 && corediameter < 10000 && coreheight >= 0 && coreheight < 10000 && coregap >= 0 && coregap < 10000
+                 && baseheight >= 0 && baseheight < 1000 && basethickness >= 0 && basethickness < 1000 && basegap >= 0
+                 && basegap < 1000 && clearance >= 0 && clearance < 100 && mazethickness < 100 && wallthickness < 100 && mazemargin >= 0
+                 && mazemargin < 1000))
+         e = "Bad size";
+      if (e)
+      {
+         printf ("{\"error\":\"%s\"}\n", e);
+         return 1;
+      }
+      long long totalpoints = 0,
+         totalfaces = 0,
+         totalbytes = 2000;     // Header and modules
+      printf ("{\"id\":\"%s\",\"parts\":%d,\"markpos0\":%s,\"part\":[", boxid, parts, (outersides && outersides / nubs * nubs != outersides) ? "true" : "false");
+      for (int p = (part ? : 1); p <= (part ? : parts); p++)
+      {
+         part_t d;
+         sizepart (p, &d);
+         printf ("%s{\"part\":%d,\"r0\":%.3f,\"r1\":%.3f,\"r2\":%.3f,\"r3\":%.3f,\"height\":%.3f,\"maze\":[", p > (part ? : 1) ? "," : "", p,
+                 d.r0, d.r1, d.r2, d.r3, d.height);
+         long long points = 0,
+            faces = 0;
+         double volume = 0;
+         int digits = 2 + log10 ((d.r3 > d.height ? d.r3 : d.height) * SCALE + 1);    // Typical coordinate, with sign and comma
+         int first = 1;
+         void plansurface (double r, int inside)
+         {
+            mazesize_t m;
+            const char *e = sizemaze (p, d.height, r, inside, &m);
+            printf ("%s{\"inside\":%s,\"W\":%d,\"H\":%d", first ? "" : ",", inside ? "true" : "false", m.W, m.H - 2 - helix);
+            first = 0;
+            if (!e && W4 (m.W) * mazeslices / 4 * (4 * (d.height / (mazestep / 4) + 10) + 32) + (long long) m.W * m.H * 5 > 8000000)
+               e = "Too large";      // makemaze works on the stack
+            if (e)
+            {
+               printf (",\"error\":\"%s\"}", e);
+               return;
+            }
+            long long cells = mazecells (&m, d.height);
+            int ridge = (parkvertical ? floorslices + 3 : mazeslices - floorslices + 1);  // Park ridge columns
+            long long mp = (long long) m.W * mazeslices * 6 + cells * mazeslices * 4 + (parkthickness ? nubs * ridge * 8 : 0),
+               mf = (long long) m.W * mazeslices * 8 + cells * mazeslices * 6 + (parkthickness ? nubs * ((ridge - 1) * 16 + 12) : 0);   // Faces depend on the random maze, this is typical
+            printf (",\"a\":%s,\"cells\":%lld,\"points\":%lld,\"faces\":%lld}", m.a ? "true" : "false", cells, mp, mf);
+            points += mp;
+            faces += mf;
+            volume -= M_PI * 2 * r * mazethickness * mazestep * 3 / 8 * cells * 2 / m.W;  // Groove cut out
+         }
+         if (d.mazeinside)
+            plansurface (d.r0, 1);
+         if (d.mazeoutside)
+            plansurface (d.r1, 0);
+         if (!d.mazeinside && !d.mazeoutside && p < parts)
+            printf ("%s{\"W\":%d,\"H\":0}", first ? "" : ",", d.W);
+         int nubpoints = (floorslices + 3) * 8,
+            nubfaces = (floorslices + 2) * 16 + 12;
+         points += (!d.mazeinside && p > 1 ? nubpoints * nubs : 0) + (!d.mazeoutside && p < parts ? nubpoints * nubs : 0);  // Nubs
+         faces += (!d.mazeinside && p > 1 ? nubfaces * nubs : 0) + (!d.mazeoutside && p < parts ? nubfaces * nubs : 0);
+         double footprint = (outersides && p + 1 >= parts) ? outersides * d.r3 * d.r3 * sin (M_PI * 2 / outersides) / 2 : M_PI * d.r2 * d.r2;
+         volume += footprint * (p == parts ? d.height : baseheight) + M_PI * (d.r1 * d.r1 - d.r0 * d.r0) * (d.height - baseheight) -
+            M_PI * d.r0 * d.r0 * (baseheight - basethickness);
+         if (volume < 0)
+            volume = 0;
+         long long bytes = 1000 + points * (3 * digits + 1) + faces * (3.2 * (1 + log10 (points + 1)) + 2);
+         printf ("],\"points\":%lld,\"faces\":%lld,\"bytes\":%lld,\"volume\":%.0f}", points, faces, bytes, volume);
+         totalpoints += points;
+         totalfaces += faces;
+         totalbytes += bytes;
+      }
+      printf ("],\"points\":%lld,\"faces\":%lld,\"bytes\":%lld}\n", totalpoints, totalfaces, totalbytes);
+      return 0;
+   }
+
+   mesh_threads = (threads > 0 ? threads : 1);  // Only when asked, as a CGI or batch runs several at once
+   if (stats || trace)
+   {                            // Options done, the rest is timed in phases
+      stat_start (started);
+   }
+   void statsout (void)
+   {                            // Report the timings
+      fflush (stdout);
+      if (stats)
+         stat_report (stderr);
+      if (trace)
+      {
+         const char *e = stat_trace (trace);
+         if (e)
+            fatal ("%s: %s", trace, e);
+      }
+   }
+   FILE *mazeoutf = NULL,
+      *mazeinf = NULL;
+   svg_maze_t *svgmaze = NULL;  // Mazes kept for --svg
+   int svgmazes = 0;
+   scene_t scene = { 0 };       // Triangles kept for --png and --glb
+   double scenex = 0,
+      sceney = 0,
+      scenea = 0;               // Where the part being made is
+   if (mazeout)
    {
-      textsidescale = 0;
-      textsides = NULL;
+      if (!(mazeoutf = fopen (mazeout, "wb")))
+         fatal ("Cannot write %s", mazeout);
+      mazefile_start (mazeoutf);
    }
-   if (helix && nubs > 1 && nubs < helix)
+   if (mazein)
    {
-      if (!(helix % 2) && nubs <= helix / 2)
-         nubs = helix / 2;
-      else
-         nubs = helix;
+      if (!(mazeinf = fopen (mazein, "rb")))
+         fatal ("Cannot read %s", mazein);
+      const char *e = mazefile_check (mazeinf);
+      if (e)
+         fatal ("%s: %s", mazein, e);
    }
-   if (helix && nubs > helix)
-      nubs = helix;
-   if (gripdepth > (baseheight - outerround) / 6)
-      gripdepth = (baseheight - outerround) / 6;
-   if (gripdepth > mazethickness)
-      gripdepth = mazethickness;
-   if (!logo && !textinside)
-      logodepth = 0;
-   if (!textsides && !textend && !textinside)
-      textdepth = 0;
-   if (coresolid && coregap < mazestep * 2)
-      coregap = mazestep * 2;
 
-   int markpos0 = (outersides && outersides / nubs * nubs != outersides);       // Mark on position zero for alignment
-   double nubskew = (symmectriccut ? 0 : mazestep / 8); // Skew the shape of the cut
+   double rendermodel[3];
+   char *renderheader = NULL;
+   size_t renderheaderlen = 0;
+   if (renderprefix)
+   {                            // Header and modules are captured and copied to each part file
+      if (render_model (rendercost ? : RENDER_COST, rendermodel))
+      {
+         fprintf (stderr, "Bad render cost model [%s]\n", rendercost);
+         return 1;
+      }
+#ifdef _WIN32
+      fprintf (stderr, "Render not supported on this platform\n");
+      return 1;
+#else
+      mime = 0;
+      gzip = 0;
+      stdout = open_memstream (&renderheader, &renderheaderlen);
+      if (!stdout)
+         fatal ("Cannot capture header");
+#endif
+   }
 
    // MIME header
+   FILE *piped = NULL,
+      *pipeout = NULL;
+   if (pipeline && (piped = pipeline_open (stdout)))
+   {                            // Compression is before the queue, so is done on this thread
+      pipeout = stdout;
+      stdout = piped;
+   }
+   const char *encoding = (gzip ? "gzip" : NULL);
+   if (mime && !encoding)
+      encoding = accept_encoding (getenv ("HTTP_ACCEPT_ENCODING"));
+   FILE *plain = stdout,
+      *deflated = NULL;
+   if (encoding && !(deflated = deflate_open (stdout, !strcmp (encoding, "gzip"))))
+   {                            // Opened before the header is sent, so with MIME it can be sent as identity instead
+      if (!mime)
+         fatal ("Compressed output not supported on this platform");
+      encoding = NULL;
+   }
    if (mime)
    {
-      printf ("Content-Type: application/scad\r\nContent-Disposition: Attachment; filename=puzzlebox");
-      int o;
-      for (o = 0; optionsTable[o].long_name; o++)
-         if (optionsTable[o].short_name && optionsTable[o].target)
-            switch (optionsTable[o].type)
-            {
-            case OPT_NONE:
-               if (!*(int *) optionsTable[o].target)
-                  break;
-               printf ("-%c", optionsTable[o].short_name);
-               break;
-            case OPT_INT:
-               if (!*(int *) optionsTable[o].target)
-                  break;
-               printf ("-%d%c", *(int *) optionsTable[o].target, optionsTable[o].short_name);
-               break;
-            case OPT_DOUBLE:
-               if (!*(double *) optionsTable[o].target)
-                  break;
-               {
-                  char temp[50], *p;
-                  sprintf (temp, "%f", *(double *) optionsTable[o].target);
-                  p = temp + strlen (temp) - 1;
-                  while (p > temp && *p == '0')
-                     *p-- = 0;
-                  if (*p == '.')
-                     *p = 0;
-                  printf ("-%s%c", temp, optionsTable[o].short_name);
-               }
-               break;
-            case OPT_STRING:
-               if (!*(char **) optionsTable[o].target)
-                  break;
-               {
-                  char *p = strdup (*(char * *) optionsTable[o].target), *q;
-                  for (q = p; q && *q; q++)
-                     if (*q <= ' ' || *q == '/' || *q == '\\' || *q == '"' || *q == '\'' || *q == ':' || *q == ';')
-                        *q = '_';
-                  if (p)
-                  {
-                     printf ("-%c%s", optionsTable[o].short_name, p);
-                     free (p);
-                  }
-               }
-               break;
-            }
-      printf (".scad\r\n\r\n"); // Used from apache
+      if (svg)
+         printf ("Content-Type: image/svg+xml\r\n");
+      else if (glb)
+         printf ("Content-Type: model/gltf-binary\r\nContent-Disposition: Attachment; filename=puzzlebox-%s.glb\r\n", boxid);
+      else
+         printf ("Content-Type: application/scad\r\nContent-Disposition: Attachment; filename=puzzlebox-%s.scad\r\n", boxid);
+      if (encoding)
+         printf ("Content-Encoding: %s\r\n", encoding);
+      printf ("\r\n");        // Used from apache
+   }
+   if (deflated)
+   {
+      fflush (stdout);
+      stdout = deflated;
+   }
+   FILE *drawout = NULL;
+   if (svg || glb)
+   {                            // The SCAD is still made, for the same mazes, but not kept
+      drawout = stdout;
+#ifdef _WIN32
+      stdout = fopen ("NUL", "w");
+#else
+      stdout = fopen ("/dev/null", "w");
+#endif
+      if (!stdout)
+         fatal ("Cannot open null output");
    }
 
+   if (stat_on && !renderprefix)
+      stdout = count_open (stdout);     // Each part file is counted when rendering
    printf ("// Puzzlebox by RevK, @TheRealRevK www.me.uk\n");
    printf ("// Thingiverse examples and instructions https://www.thingiverse.com/thing:2410748\n");
    printf ("// GitHub source https://github.com/revk/PuzzleBox\n");
    printf ("// Get new random custom maze gift boxes from https://www.me.uk/puzzlebox\n");
    {                            // Document args
-      time_t now = time (0);
+      time_t now = (getenv ("SOURCE_DATE_EPOCH") ? strtoll (getenv ("SOURCE_DATE_EPOCH"), NULL, 10) : time (0));  // Reproducible
       struct tm t;
       if (!gmtime_utc (&now, &t))
          memset (&t, 0, sizeof (t));
       printf ("// Created %04d-%02d-%02dT%02d:%02d:%02dZ %s\n", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min,
               t.tm_sec, getenv ("REMOTE_ADDR") ? : "");
+      if (mazein)
+         printf ("// No box ID, the mazes are from a maze file\n");     // The ID would make new mazes
+      else
+         printf ("// Box ID %s\n", boxid);
       int o;
       for (o = 0; optionsTable[o].long_name; o++)
          if (optionsTable[o].short_name && optionsTable[o].target)
@@ -729,7 +5005,9 @@ main (int argc, const char *argv[])
          printf ("module cuttext(){linear_extrude(height=%lld,convexity=10,center=true)mirror([1,0,0])children();}\n",
                  scaled (textdepth));
       // You can use the A&A logo on your maze print providing it is tasteful and not in any way derogatory to A&A or any staff/officers.
-      if (logo)
+      if (logo && textnative)
+         logo_module (logon);
+      else if (logo)
          printf
             ("module aa(w=100,white=0,$fn=100){scale(w/100){if(!white)difference(){circle(d=100.5);circle(d=99.5);}difference(){if(white)circle(d=100);difference(){circle(d=92);for(m=[0,1])mirror([m,0,0]){difference(){translate([24,0,0])circle(r=22.5);translate([24,0,0])circle(r=15);}polygon([[1.5,22],[9,22],[9,-18.5],[1.5,-22]]);}}}}} // A&A Logo is copyright (c) 2013 and trademark Andrews & Arnold Ltd\n");
    }
@@ -739,6 +5017,13 @@ main (int argc, const char *argv[])
          printf ("mirror([0,0,1])");
       printf ("cuttext()");
       printf ("scale(%lld)", scaled (1));
+#ifdef HAVE_FREETYPE
+      if (textnative)
+      {
+         text_polygon (t, f, s);
+         return;
+      }
+#endif
       printf ("text(\"%s\"", t);
       printf (",halign=\"center\"");
       printf (",valign=\"center\"");
@@ -749,9 +5034,11 @@ main (int argc, const char *argv[])
          printf (",font=\"%s\"", f);
       printf (");\n");
    }
+   if (library)
+      printf ("use <puzzlebox.scad>\n");
    // The base
-   printf ("module outer(h,r){e=%lld;minkowski(){cylinder(r1=0,r2=e,h=e,$fn=24);cylinder(h=h-e,r=r,$fn=%d);}}\n",
-           scaled (outerround), outersides ? : 100);
+   printf ("module outer(h,r){e=%lld;minkowski(){cylinder(r1=0,r2=e,h=e,$fn=%d);cylinder(h=h-e,r=r,$fn=%d);}}\n",
+           scaled (outerround), segments (outerround, 24), outersides ? : roundn);
    // Start
    double x = 0,
       y = 0;
@@ -765,91 +5052,37 @@ main (int argc, const char *argv[])
         Z,
         S;
       double entrya = 0;        // Entry angle
-      int mazeinside = inside;  // This part has maze inside
-      int mazeoutside = !inside;        // This part has maze outside
-      int nextinside = inside;  // Next part has maze inside
-      int nextoutside = !inside;        // Next part has maze outside
-      if (flip)
-      {
-         if (part & 1)
-         {
-            mazeinside = 1 - mazeinside;
-            nextoutside = 1 - nextoutside;
-         } else
-         {
-            mazeoutside = 1 - mazeoutside;
-            nextinside = 1 - nextinside;
-         }
-      }
-      if (part == 1)
-         mazeinside = 0;
-      if (part == parts)
-         mazeoutside = 0;
-      if (part + 1 >= parts)
-         nextoutside = 0;
-      if (part == parts)
-         nextinside = 0;
-      // Dimensions
-      // r0 is inside of part+maze
-      // r1 is outside of part+maze
-      // r2 is outside of base before "sides" adjust
-      // r3 is outside of base with "sides" adjust
-      double r1 = corediameter / 2 + wallthickness + (part - 1) * (wallthickness + mazethickness + clearance);  // Outer
-      if (coresolid)
-         r1 -= wallthickness + mazethickness + clearance - (inside ? mazethickness : 0);        // Adjust to make part 2 the core diameter
-      int W = ((int) (r1 * 2 * M_PI / mazestep)) / nubs * nubs; // Default value
-      double r0 = r1 - wallthickness;   // Inner
-      if (mazeinside && part > 1)
-         r0 -= mazethickness;   // Maze on inside
-      if (mazeoutside && part < parts)
-         r1 += mazethickness;   // Maze on outside
-      double r2 = r1;           // Base outer
-      if (part < parts)
-         r2 += clearance;
-      if (part + 1 >= parts && textsides && !textoutset)
-         r2 += textdepth;
-      if (nextinside)
-         r2 += mazethickness;
-      if (nextoutside || part + 1 == parts)
-         r2 += wallthickness;
-      if (basewide && part + 1 < parts)
-         r2 += nextoutside ? mazethickness : wallthickness;
-      double r3 = r2;
-      if (outersides && part + 1 >= parts)
-         r3 /= cos ((double) M_PI / outersides);        // Bigger because of number of sides
+      int st = stat_begin ("part", part, -1);
+      part_t d;
+      sizepart (part, &d);
+      int mazeinside = d.mazeinside;    // This part has maze inside
+      int mazeoutside = d.mazeoutside; // This part has maze outside
+      int nextoutside = d.nextoutside; // Next part has maze outside
+      int W = d.W;
+      double r0 = d.r0,
+         r1 = d.r1,
+         r2 = d.r2,
+         r3 = d.r3;
       printf ("// Part %d (%.2fmm to %.2fmm and %.2fmm/%.2fmm base)\n", part, r0, r1, r2, r3);
-      double height = (coresolid ? coregap + baseheight : 0) + coreheight + basethickness + (basethickness + basegap) * (part - 1);
-      if (part == 1)
-         height -= (coresolid ? coreheight : coregap);
-      if (part > 1)
-         height -= baseheight;  // base from previous unit is added to this
+      double height = d.height;
       // Output
       void makemaze (double r, int inside)
       {                         // Make the maze
-         W = ((int) ((r + (inside ? mazethickness : -mazethickness)) * 2 * M_PI / mazestep)) / nubs * nubs;     // Update W for actual maze
-         double base = (inside ? basethickness : baseheight);
-         if (inside && part > 2)
-            base += baseheight; // Nubs don't go all the way to the end
-         if (inside && part == 2)
-            base += (coresolid ? coreheight : coregap); // First one is short...
-         if (inside)
-            base += basegap;
-         double h = height - base - mazemargin - (parkvertical ? mazestep / 4 : 0) - mazestep / 8;
-         int H = (int) (h / mazestep);
-         printf ("// Maze %s %d/%d\n", inside ? "inside" : "outside", W, H);
-         double y0 = base + mazestep / 2 - mazestep * (helix + 1) + mazestep / 8;
-         H += 2 + helix;        // Allow one above, one below and helix below
-         if (W < 3 || H < 1)
-            fatal ("Too small");
-         double dy = 0;
-         if (helix)
-         {
-            dy = mazestep * helix / W;
-         }
+         mazesize_t m;
+         const char *e = sizemaze (part, height, r, inside, &m);
+         W = m.W;
+         int H = m.H;
+         double base = m.base;
+         printf ("// Maze %s %d/%d\n", inside ? "inside" : "outside", W, H - 2 - helix);
+         if (e)
+            fatal ("%s", e);
+         double y0 = m.y0;
+         double dy = m.dy;
          unsigned char maze[W][H];
          memset (maze, 0, sizeof (unsigned char) * W * H);
          int test (int x, int y)
          {                      // Test if in use...
+            count_tests++;
             while (x < 0)
             {
                x += W;
@@ -881,6 +5114,7 @@ main (int argc, const char *argv[])
             }
             return v;
          }
+         int st = stat_begin ("maze", part, inside);
          {                      // Maze
             double margin = mazemargin;
             // Make maze
@@ -898,7 +5132,7 @@ main (int argc, const char *argv[])
                   maze[0][N] |= FLAGU + FLAGD;
                   maze[X = 0][Y = N + 1] |= FLAGD;
                }
-               if (!inside && !noa && W / nubs > 2 && H > helix + 4)
+               if (m.a)
                {                // An "A" at finish
                   maze[X][Y] |= FLAGD | FLAGU | FLAGR;
                   maze[X][Y + 1] |= FLAGD | FLAGR;
@@ -912,7 +5146,7 @@ main (int argc, const char *argv[])
             {
                maze[0][helix + 1] |= FLAGR;
                maze[X = 1][Y = helix + 1] |= FLAGL;
-               if (!inside && !noa && W / nubs > 3 && H > helix + 3)
+               if (m.a)
                {                // An "A" at finish
                   maze[X][Y] |= FLAGL | FLAGR | FLAGU;
                   maze[X + 1][Y] |= FLAGL | FLAGU;
@@ -924,8 +5158,22 @@ main (int argc, const char *argv[])
                }
             }
             // Make maze
-            int maxx = 0;
-            if (testmaze)
+            int maxx = 0,
+               max = -1,
+               made = 0;        // Mazes made, if best of many
+            double score = 0;
+            maze_t mz = { W, H, helix, nubs, &maze[0][0], 0, parkvertical };
+            if (mazeinf)
+            {                   // Previously made
+               const char *e = maze_load (mazeinf, part, inside, &mz, &max, &made, &score);
+               if (e)
+                  fatal ("%s: %s", mazein, e);
+               if (made)
+                  printf ("// Best of %d mazes, difficulty %.1f\n", made, score);
+               if (max >= 0)
+                  printf ("// Path length %d\n", max);
+               maxx = mz.maxx;
+            } else if (testmaze)
             {                   // Simple test pattern
                for (Y = 0; Y < H; Y++)
                   for (X = 0; X < W; X++)
@@ -946,129 +5194,25 @@ main (int argc, const char *argv[])
                      maxx++;
             } else
             {                   // Actual maze
-               int max = 0;
-               typedef struct pos_s pos_t;
-               struct pos_s
-               {
-                  pos_t *next;
-                  int x,
-                    y,
-                    n;
-               };
-               pos_t *pos = malloc (sizeof (*pos)),
-                  *last = NULL;
-               pos->x = X;
-               pos->y = Y;
-               pos->n = 0;
-               pos->next = NULL;
-               last = pos;
-               while (pos)
+               if (candidates > 1 || timebudget > 0)
+               {                // Best of many
+                  unsigned int seed = (random_int (32768) << 15) ^ random_int (32768);
+                  max = maze_best (&mz, X, Y, mazecomplexity, flip, inside, seed, candidates, timebudget, threads, &made, &score);
+                  printf ("// Best of %d mazes, difficulty %.1f\n", made, score);
+               } else
                {
-                  pos_t *p = pos;
-                  pos = p->next;
-                  p->next = NULL;
-                  if (!pos)
-                     last = NULL;
-                  // Where we are
-                  X = p->x;
-                  Y = p->y;
-                  int v,
-                    n = 0;
-                  // Which way can we go
-                  // Some bias for direction
-                  if (!test (X + 1, Y))
-                     n += BIASR;        // Right
-                  if (!test (X - 1, Y))
-                     n += BIASL;        // Left
-                  if (!test (X, Y - 1))
-                     n += BIASD;        // Down
-                  if (!test (X, Y + 1))
-                     n += BIASU;        // Up
-                  if (!n)
-                  {             // No way forward
-                     free (p);
-                     continue;
-                  }
-                  // Pick one of the ways randomly
-                  v = random_int (n);
-                  // Move forward
-                  if (!test (X + 1, Y) && (v -= BIASR) < 0)
-                  {             // Right
-                     maze[X][Y] |= FLAGR;
-                     X++;
-                     if (X >= W)
-                     {
-                        X -= W;
-                        Y += helix;
-                     }
-                     maze[X][Y] |= FLAGL;
-                  } else if (!test (X - 1, Y) && (v -= BIASL) < 0)
-                  {             // Left
-                     maze[X][Y] |= FLAGL;
-                     X--;
-                     if (X < 0)
-                     {
-                        X += W;
-                        Y -= helix;
-                     }
-                     maze[X][Y] |= FLAGR;
-                  } else if (!test (X, Y - 1) && (v -= BIASD) < 0)
-                  {             // Down
-                     maze[X][Y] |= FLAGD;
-                     Y--;
-                     maze[X][Y] |= FLAGU;
-                  } else if (!test (X, Y + 1) && (v -= BIASU) < 0)
-                  {             // Up
-                     maze[X][Y] |= FLAGU;
-                     Y++;
-                     maze[X][Y] |= FLAGD;
-                  } else
-                     fatal ("Unexpected maze path");   // We should have picked a way we can go
-                  // Entry
-                  if (p->n > max && (test (X, Y + 1) & FLAGI)   //
-                      && (!flip || inside || !(X % (W / nubs))))
-                  {             // Longest path that reaches top
-                     max = p->n;
-                     maxx = X;
-                  }
-                  // Next point to consider
-                  pos_t *next = malloc (sizeof (*next));
-                  next->x = X;
-                  next->y = Y;
-                  next->n = p->n + 1;
-                  next->next = NULL;
-                  // How to add points to queue... start or end
-                  v = random_int (10);
-                  if (v < (mazecomplexity < 0 ? -mazecomplexity : mazecomplexity))
-                  {             // add next point at start - makes for longer path
-                     if (!pos)
-                        last = next;
-                     next->next = pos;
-                     pos = next;
-                  } else
-                  {             // add next point at end - makes for multiple paths, which can mean very simple solution
-                     if (last)
-                        last->next = next;
-                     else
-                        pos = next;
-                     last = next;
-                  }
-                  if (mazecomplexity <= 0 && v < -mazecomplexity)
-                  {             // current point to start
-                     if (!pos)
-                        last = p;
-                     p->next = pos;
-                     pos = p;
-                  } else
-                  {
-                     if (last)
-                        last->next = p;
-                     else
-                        pos = p;
-                     last = p;
-                  }
+                  seed_rng ();
+                  max = maze_generate (&mz, X, Y, mazecomplexity, flip, inside, &rng_state);
                }
                printf ("// Path length %d\n", max);
+               maxx = mz.maxx;
+            }
+            if (mazeoutf)
+            {
+               mz.maxx = maxx;
+               const char *e = maze_save (mazeoutf, part, inside, &mz, max, made, score);
+               if (e)
+                  fatal ("%s: %s", mazeout, e);
             }
             entrya = (double) 360 *maxx / W;
             // Entry point for maze
@@ -1079,7 +5223,37 @@ main (int argc, const char *argv[])
                   maze[X][Y--] |= FLAGU + FLAGD;
                maze[X][Y] += FLAGU;
             }
+            stat_end (st);
+            if (analyse)
+            {
+               mz.maxx = maxx;
+               maze_stats_t st;
+               maze_analyse (&mz, &st, NULL, 0);
+               fprintf (stderr,
+                        "{\"part\":%d,\"inside\":%s,\"W\":%d,\"H\":%d,\"cells\":%d,\"path\":%d,\"deadends\":%d,\"junctions\":%d,\"branch\":%.3f,\"reversals\":%d}\n",
+                        part, inside ? "true" : "false", W, H - 2 - helix, st.cells, st.path, st.deadends, st.junctions, st.branch,
+                        st.reversals);
+            }
+            if (svg)
+            {                   // Keep the maze to draw, no geometry needed
+               svgmaze = realloc (svgmaze, sizeof (*svgmaze) * (svgmazes + 1));
+               if (!svgmaze || !(svgmaze[svgmazes].m.maze = malloc (W * H)))
+                  fatal ("Out of memory");
+               svg_maze_t *n = &svgmaze[svgmazes++];
+               n->part = part;
+               n->inside = inside;
+               n->a = m.a;
+               n->m.W = W;
+               n->m.H = H;
+               n->m.helix = helix;
+               n->m.nubs = nubs;
+               n->m.maxx = maxx;
+               n->m.parkvertical = parkvertical;
+               memcpy (n->m.maze, &maze[0][0], W * H);
+               return;
+            }
 
+            const int K = mazeslices;   // Slices per cell
             int MAXY = height / (mazestep / 4) + 10;
             struct
             {                   // Data for each slive
@@ -1092,18 +5266,20 @@ main (int argc, const char *argv[])
                // Points from bottom up on this slice in order - used to ensure manifold buy using points that would be skipped
                int n;           // Points added to p
                int p[MAXY];
-            } s[W * 4];
-            memset (&s, 0, sizeof (*s) * W * 4);
-            int p[W][H];        // The point start for each usable maze location (0 for not set) - 16 points
+            } s[W * K];
+            memset (&s, 0, sizeof (*s) * W * K);
+            int p[W][H];        // The point start for each usable maze location (0 for not set) - 4 rows of K points
             memset (*p, 0, sizeof (int) * W * H);
             // Work out pre-sets
-            for (S = 0; S < W * 4; S++)
+            for (S = 0; S < W * K; S++)
             {
-               double a = M_PI * 2 * (S - 1.5) / W / 4;
+               double a = M_PI * 2 * (slicepos (S) - 1.5) / W / 4;
                if (!inside)
                   a = M_PI * 2 - a;
                double sa = sin (a),
                   ca = cos (a);
+               if (deterministic)
+                  trig_sincos ((inside ? 1 : -1) * (slicepos (S) - 1.5) / (W * 4), &sa, &ca);
                if (inside)
                {
                   s[S].x[0] = (r + mazethickness + (part < parts ? wallthickness : clearance + 0.01)) * sa;
@@ -1122,274 +5298,372 @@ main (int argc, const char *argv[])
                   s[S].y[2] = r * ca;
                }
             }
-            if (inside && mirrorinside)
-               printf ("mirror([1,0,0])");
-            printf ("polyhedron(");
-            // Make points
-            printf ("points=[");
-            int P = 0;
-            void addpoint (int S, double x, double y, double z)
-            {
-               printf ("[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
-               if (s[S].n >= MAXY)
-                  fatal ("WTF points %d", S);
-               s[S].p[s[S].n++] = P++;
-            }
-            void addpointr (int S, double x, double y, double z)
-            {
-               printf ("[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
-               if (s[S].n >= MAXY)
-                  fatal ("WTF points %d", S);
-               s[S].p[s[S].n++] = -(P++);
-            }
-            int bottom = P;
-            // Base points
-            for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[0], s[S].y[0], basethickness - clearance);
-            for (S = 0; S < W * 4; S++)
-               addpointr (S, s[S].x[1], s[S].y[1], basethickness - clearance);
-            for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[2], s[S].y[2], basethickness - clearance);
-            {                   // Points for each maze location
-               double dy = mazestep * helix / W / 4;    // Step per S
-               double my = mazestep / 8;        // Vertical steps
-               double y = y0 - dy * 1.5;        // Y vertical centre for S=0
-               for (Y = 0; Y < H; Y++)
-                  for (X = 0; X < W; X++)
-                  {
-                     unsigned char v = test (X, Y);
-                     if (!(v & FLAGA) || (v & FLAGI))
-                        continue;
-                     p[X][Y] = P;
-                     for (S = X * 4; S < X * 4 + 4; S++)
-                        addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * S - my * 3);
-                     for (S = X * 4; S < X * 4 + 4; S++)
-                        addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * S - my - nubskew);
-                     for (S = X * 4; S < X * 4 + 4; S++)
-                        addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * S + my - nubskew);
-                     for (S = X * 4; S < X * 4 + 4; S++)
-                        addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * S + my * 3);
-                  }
-            }
-            int top = P;
-            for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[2], s[S].y[2], height - (basewide && !inside && part > 1 ? 0 : margin));     // lower
-            for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[1], s[S].y[1], height);
-            for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[0], s[S].y[0], height);
-            for (S = 0; S < W * 4; S++)
-            {                   // Wrap back to start
-               if (s[S].n >= MAXY)
-                  fatal ("WTF points");
-               s[S].p[s[S].n++] = S;
-            }
-            printf ("]");
-            // Make faces
-            void slice (int S, int l, int r)
-            {                   // Advance slice S to new L and R (-ve for recess)
-               inline int abs (int x)
+            if (library)
+            {                   // Data for puzzlebox.scad to make the maze
+               st = stat_begin ("emit", part, inside);
+               if (inside && mirrorinside)
+                  printf ("mirror([1,0,0])");
+               printf ("puzzlebox_maze(version=%d,W=%d,H=%d,helix=%d,inside=%s,", LIBRARY_VERSION, W, H, helix, inside ? "true" : "false");
+               printf ("r=%lld,depth=%lld,back=%lld,step=%lld,y0=%lld,skew=%lld,", scaled (r), scaled (mazethickness),
+                       scaled (inside ? r + mazethickness + (part < parts ? wallthickness : clearance + 0.01) : r - mazethickness - wallthickness),
+                       scaled (mazestep), scaled (y0), scaled (nubskew));
+               printf ("bottom=%lld,lower=%lld,top=%lld,slices=%d,grid=[", scaled (basethickness - clearance),
+                       scaled (height - (basewide && !inside && part > 1 ? 0 : margin)), scaled (height), mazeslices);
+               for (X = 0; X < W; X++)
                {
-                  if (x < 0)
-                     return -x;
-                  return x;
+                  printf ("%s[", X ? "," : "");
+                  for (Y = 0; Y < H; Y++)
+                     printf ("%s%d", Y ? "," : "", test (X, Y));
+                  printf ("]");
                }
-               inline int sgn (int x)
+               printf ("]);\n");
+               stat_end (st);
+            } else
+            {                   // Polyhedron
+               if (inside && mirrorinside)
+                  printf ("mirror([1,0,0])");
+               printf ("polyhedron(");
+               // Make points
+               st = stat_begin ("points", part, inside);
+               mesh_t mesh = { 0 };
+               int P = 0;
+               void addpoint (int S, double x, double y, double z)
                {
-                  if (x < 0)
-                     return -1;
-                  if (x > 0)
-                     return 1;
-                  return 0;
+                  mesh_point (&mesh, scaled (x), scaled (y), scaled (z));
+                  if (s[S].n >= MAXY)
+                     fatal ("WTF points %d", S);
+                  s[S].p[s[S].n++] = P++;
                }
-               if (S >= W * 4)
-                  fatal ("Bad render %d", S);
-               if (!s[S].l)
-               {                // New - draw to bottom
-                  s[S].l = (l < 0 ? -1 : 1) * (bottom + S + W * 4 + (l < 0 ? 0 : W * 4));
-                  s[S].r = (r < 0 ? -1 : 1) * (bottom + (S + 1) % (W * 4) + W * 4 + (r < 0 ? 0 : W * 4));
-                  printf ("[%d,%d,%d,%d],", abs (s[S].l), abs (s[S].r), (S + 1) % (W * 4), S);
-               }
-               // Advance
-               if (l == s[S].l && r == s[S].r)
-                  return;
-               int SR = (S + 1) % (W * 4);
-               printf ("[");
-               int p = 0;
-               int n1,
-                 n2;
-               for (n1 = 0; n1 < s[S].n && abs (s[S].p[n1]) != abs (s[S].l); n1++);
-               for (n2 = n1; n2 < s[S].n && abs (s[S].p[n2]) != abs (l); n2++);
-               if (n1 == s[S].n || n2 == s[S].n)
-                  fatal ("Bad render %d->%d", s[S].l, l);
-               while (n1 < n2)
+               void addpointr (int S, double x, double y, double z)
                {
-                  if (sgn (s[S].p[n1]) == sgn (s[S].l))
+                  mesh_point (&mesh, scaled (x), scaled (y), scaled (z));
+                  if (s[S].n >= MAXY)
+                     fatal ("WTF points %d", S);
+                  s[S].p[s[S].n++] = -(P++);
+               }
+               int bottom = P;
+               // Base points
+               for (S = 0; S < W * K; S++)
+                  addpoint (S, s[S].x[0], s[S].y[0], basethickness - clearance);
+               for (S = 0; S < W * K; S++)
+                  addpointr (S, s[S].x[1], s[S].y[1], basethickness - clearance);
+               for (S = 0; S < W * K; S++)
+                  addpoint (S, s[S].x[2], s[S].y[2], basethickness - clearance);
+               {                // Points for each maze location
+                  double dy = mazestep * helix / W / 4; // Step per quarter cell
+                  double my = mazestep / 8;     // Vertical steps
+                  double y = y0 - dy * 1.5;     // Y vertical centre for S=0
+                  for (Y = 0; Y < H; Y++)
+                     for (X = 0; X < W; X++)
+                     {
+                        unsigned char v = test (X, Y);
+                        if (!(v & FLAGA) || (v & FLAGI))
+                           continue;
+                        p[X][Y] = P;
+                        for (S = X * K; S < X * K + K; S++)
+                           addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * slicepos (S) - my * 3);
+                        for (S = X * K; S < X * K + K; S++)
+                           addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * slicepos (S) - my - nubskew);
+                        for (S = X * K; S < X * K + K; S++)
+                           addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * slicepos (S) + my - nubskew);
+                        for (S = X * K; S < X * K + K; S++)
+                           addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * slicepos (S) + my * 3);
+                     }
+               }
+               int top = P;
+               for (S = 0; S < W * K; S++)
+                  addpoint (S, s[S].x[2], s[S].y[2], height - (basewide && !inside && part > 1 ? 0 : margin));  // lower
+               for (S = 0; S < W * K; S++)
+                  addpoint (S, s[S].x[1], s[S].y[1], height);
+               for (S = 0; S < W * K; S++)
+                  addpoint (S, s[S].x[0], s[S].y[0], height);
+               for (S = 0; S < W * K; S++)
+               {                // Wrap back to start
+                  if (s[S].n >= MAXY)
+                     fatal ("WTF points");
+                  s[S].p[s[S].n++] = S;
+               }
+               stat_end (st);
+               // Make faces
+               st = stat_begin ("faces", part, inside);
+               void slice (int S, int l, int r)
+               {                // Advance slice S to new L and R (-ve for recess)
+                  inline int abs (int x)
                   {
-                     printf ("%d,", abs (s[S].p[n1]));
-                     p++;
+                     if (x < 0)
+                        return -x;
+                     return x;
                   }
-                  n1++;
-               }
-               printf ("%d,", abs (l));
-               if (p)
-                  printf ("%d],", abs (r));     // Triangles
-               for (n1 = 0; n1 < s[SR].n && abs (s[SR].p[n1]) != abs (s[S].r); n1++);
-               for (n2 = n1; n2 < s[SR].n && abs (s[SR].p[n2]) != abs (r); n2++);
-               if (n1 == s[SR].n || n2 == s[SR].n)
-                  fatal ("Bad render %d->%d", r, s[S].r);
-               if (!p || n1 < n2)
-               {
-                  n2--;
-                  if (p)
-                     printf ("[");
-                  printf ("%d", abs (r));
-                  while (n1 <= n2)
+                  inline int sgn (int x)
                   {
-                     if (sgn (s[SR].p[n2]) == sgn (s[S].r))
-                        printf (",%d", abs (s[SR].p[n2]));
-                     n2--;
+                     if (x < 0)
+                        return -1;
+                     if (x > 0)
+                        return 1;
+                     return 0;
+                  }
+                  count_slices++;
+                  if (S >= W * K)
+                     fatal ("Bad render %d", S);
+                  if (!s[S].l)
+                  {             // New - draw to bottom
+                     s[S].l = (l < 0 ? -1 : 1) * (bottom + S + W * K + (l < 0 ? 0 : W * K));
+                     s[S].r = (r < 0 ? -1 : 1) * (bottom + (S + 1) % (W * K) + W * K + (r < 0 ? 0 : W * K));
+                     int f[4] = { abs (s[S].l), abs (s[S].r), (S + 1) % (W * K), S };
+                     mesh_face (&mesh, 4, f);
                   }
+                  // Advance
+                  if (l == s[S].l && r == s[S].r)
+                     return;
+                  int SR = (S + 1) % (W * K);
+                  int f[s[S].n + s[SR].n + 2];  // Face being made
+                  int n = 0;
+                  int p = 0;
+                  int n1,
+                    n2;
+                  for (n1 = 0; n1 < s[S].n && abs (s[S].p[n1]) != abs (s[S].l); n1++);
+                  for (n2 = n1; n2 < s[S].n && abs (s[S].p[n2]) != abs (l); n2++);
+                  if (n1 == s[S].n || n2 == s[S].n)
+                     fatal ("Bad render %d->%d", s[S].l, l);
+                  while (n1 < n2)
+                  {
+                     if (sgn (s[S].p[n1]) == sgn (s[S].l))
+                     {
+                        f[n++] = abs (s[S].p[n1]);
+                        p++;
+                     }
+                     n1++;
+                  }
+                  f[n++] = abs (l);
                   if (p)
-                     printf (",%d", abs (s[S].l));
-                  printf ("],");
-               }
-               s[S].l = l;
-               s[S].r = r;
-            }
-            printf (",\nfaces=[");
-            // Maze
-            for (Y = 0; Y < H; Y++)
-               for (X = 0; X < W; X++)
-               {
-                  unsigned char v = test (X, Y);
-                  if (!(v & FLAGA) || (v & FLAGI))
-                     continue;
-                  S = X * 4;
-                  int P = p[X][Y];
-                  // Left
-                  if (!(v & FLAGD))
-                     slice (S + 0, P + 0, P + 1);
-                  slice (S + 0, P + 0, -(P + 5));
-                  if (v & FLAGL)
                   {
-                     slice (S + 0, -(P + 4), -(P + 5));
-                     slice (S + 0, -(P + 8), -(P + 9));
+                     f[n++] = abs (r);  // Triangles
+                     mesh_face (&mesh, n, f);
+                     n = 0;
                   }
-                  slice (S + 0, P + 12, -(P + 9));
-                  if (!(v & FLAGU))
-                     slice (S + 0, P + 12, P + 13);
-                  // Middle
-                  if (!(v & FLAGD))
-                     slice (S + 1, P + 1, P + 2);
-                  slice (S + 1, -(P + 5), -(P + 6));
-                  slice (S + 1, -(P + 9), -(P + 10));
-                  if (!(v & FLAGU))
-                     slice (S + 1, P + 13, P + 14);
-                  // Right
-                  if (!(v & FLAGD))
-                     slice (S + 2, P + 2, P + 3);
-                  slice (S + 2, -(P + 6), P + 3);
-                  if (v & FLAGR)
+                  for (n1 = 0; n1 < s[SR].n && abs (s[SR].p[n1]) != abs (s[S].r); n1++);
+                  for (n2 = n1; n2 < s[SR].n && abs (s[SR].p[n2]) != abs (r); n2++);
+                  if (n1 == s[SR].n || n2 == s[SR].n)
+                     fatal ("Bad render %d->%d", r, s[S].r);
+                  if (!p || n1 < n2)
                   {
-                     slice (S + 2, -(P + 6), -(P + 7));
-                     slice (S + 2, -(P + 10), -(P + 11));
+                     n2--;
+                     f[n++] = abs (r);
+                     while (n1 <= n2)
+                     {
+                        if (sgn (s[SR].p[n2]) == sgn (s[S].r))
+                           f[n++] = abs (s[SR].p[n2]);
+                        n2--;
+                     }
+                     if (p)
+                        f[n++] = abs (s[S].l);
+                     mesh_face (&mesh, n, f);
                   }
-                  slice (S + 2, -(P + 10), P + 15);
-                  if (!(v & FLAGU))
-                     slice (S + 2, P + 14, P + 15);
-                  {             // Joining to right
-                     int x = X + 1,
-                        y = Y;
-                     if (x >= W)
+                  s[S].l = l;
+                  s[S].r = r;
+               }
+               // Maze
+               for (Y = 0; Y < H; Y++)
+                  for (X = 0; X < W; X++)
+                  {
+                     unsigned char v = test (X, Y);
+                     if (!(v & FLAGA) || (v & FLAGI))
+                        continue;
+                     S = X * K;
+                     int P = p[X][Y];
+                     int E = K - 1,     // Right column, rows are K points
+                        G = floorslices + 2;    // Top of right wall
+                     // Left
+                     if (!(v & FLAGD))
+                        slice (S + 0, P + 0, P + 1);
+                     slice (S + 0, P + 0, -(P + K + 1));
+                     if (v & FLAGL)
+                     {
+                        slice (S + 0, -(P + K), -(P + K + 1));
+                        slice (S + 0, -(P + K * 2), -(P + K * 2 + 1));
+                     }
+                     slice (S + 0, P + K * 3, -(P + K * 2 + 1));
+                     if (!(v & FLAGU))
+                        slice (S + 0, P + K * 3, P + K * 3 + 1);
+                     // Middle
+                     for (int c = 1; c < G - 1; c++)
+                     {
+                        if (!(v & FLAGD))
+                           slice (S + c, P + c, P + c + 1);
+                        slice (S + c, -(P + K + c), -(P + K + c + 1));
+                        slice (S + c, -(P + K * 2 + c), -(P + K * 2 + c + 1));
+                        if (!(v & FLAGU))
+                           slice (S + c, P + K * 3 + c, P + K * 3 + c + 1);
+                     }
+                     // Right
+                     if (!(v & FLAGD))
+                        slice (S + G - 1, P + G - 1, P + G);
+                     slice (S + G - 1, -(P + K + G - 1), P + G);
+                     if (v & FLAGR)
                      {
-                        x -= W;
-                        y += helix;
+                        slice (S + G - 1, -(P + K + G - 1), -(P + K + G));
+                        slice (S + G - 1, -(P + K * 2 + G - 1), -(P + K * 2 + G));
                      }
-                     if (y >= 0 && y < H)
+                     slice (S + G - 1, -(P + K * 2 + G - 1), P + K * 3 + G);
+                     if (!(v & FLAGU))
+                        slice (S + G - 1, P + K * 3 + G - 1, P + K * 3 + G);
+                     // Land
+                     for (int c = G; c < E; c++)
                      {
-                        int PR = p[x][y];
-                        if (PR)
+                        slice (S + c, P + c, P + c + 1);
+                        if (v & FLAGR)
+                        {
+                           slice (S + c, -(P + K + c), -(P + K + c + 1));
+                           slice (S + c, -(P + K * 2 + c), -(P + K * 2 + c + 1));
+                        }
+                        slice (S + c, P + K * 3 + c, P + K * 3 + c + 1);
+                     }
+                     {          // Joining to right
+                        int x = X + 1,
+                           y = Y;
+                        if (x >= W)
+                        {
+                           x -= W;
+                           y += helix;
+                        }
+                        if (y >= 0 && y < H)
                         {
-                           slice (S + 3, P + 3, PR + 0);
-                           if (v & FLAGR)
+                           int PR = p[x][y];
+                           if (PR)
                            {
-                              slice (S + 3, -(P + 7), -(PR + 4));
-                              slice (S + 3, -(P + 11), -(PR + 8));
+                              slice (S + E, P + E, PR + 0);
+                              if (v & FLAGR)
+                              {
+                                 slice (S + E, -(P + K + E), -(PR + K));
+                                 slice (S + E, -(P + K * 2 + E), -(PR + K * 2));
+                              }
+                              slice (S + E, P + K * 3 + E, PR + K * 3);
                            }
-                           slice (S + 3, P + 15, PR + 12);
                         }
                      }
                   }
+               // Top
+               for (S = 0; S < W * K; S++)
+               {
+                  //slice (S, (s[S].l < 0 ? -1 : 1) * (top + S + (s[S].l < 0 ? W * K : 0)), (s[S].r < 0 ? -1 : 1) * (top + ((S + 1) % (W * K)) + (s[S].r < 0 ? W * K : 0)));
+                  slice (S, top + S + (s[S].l < 0 ? W * K : 0), top + ((S + 1) % (W * K)) + (s[S].r < 0 ? W * K : 0));
+                  slice (S, top + S + W * K, top + ((S + 1) % (W * K)) + W * K);
+                  slice (S, top + S + 2 * W * K, top + ((S + 1) % (W * K)) + 2 * W * K);
+                  slice (S, bottom + S, bottom + (S + 1) % (W * K));
                }
-            // Top
-            for (S = 0; S < W * 4; S++)
-            {
-               //slice (S, (s[S].l < 0 ? -1 : 1) * (top + S + (s[S].l < 0 ? W * 4 : 0)), (s[S].r < 0 ? -1 : 1) * (top + ((S + 1) % (W * 4)) + (s[S].r < 0 ? W * 4 : 0)));
-               slice (S, top + S + (s[S].l < 0 ? W * 4 : 0), top + ((S + 1) % (W * 4)) + (s[S].r < 0 ? W * 4 : 0));
-               slice (S, top + S + W * 4, top + ((S + 1) % (W * 4)) + W * 4);
-               slice (S, top + S + 2 * W * 4, top + ((S + 1) % (W * 4)) + 2 * W * 4);
-               slice (S, bottom + S, bottom + (S + 1) % (W * 4));
+               stat_end (st);
+               // Done
+               char name[50];
+               snprintf (name, sizeof (name), "Part %d maze %s", part, inside ? "inside" : "outside");
+               st = stat_begin ("emit", part, inside);
+               mesh_emit (&mesh, ",\n", name);
+               stat_end (st);
+               if (png || glb)
+                  scene_mesh (&scene, &mesh, part, scenex, sceney, scenea, 1, inside && mirrorinside);
+               count_points += mesh.points;
+               count_faces += mesh.faces;
+               mesh_free (&mesh);
+               printf (",convexity=10");
+               printf (");\n");
             }
-            printf ("]");
-            printf (",convexity=10");
-            // Done
-            printf (");\n");
             if (parkthickness)
             {                   // Park ridge
                if (inside && mirrorinside)
                   printf ("mirror([1,0,0])");
-               printf ("polyhedron(points=[");
+               printf ("polyhedron(");
+               mesh_t mesh = { 0 };
+               int C = (parkvertical ? floorslices + 3 : K - floorslices + 1);  // Columns, across the groove, or across the land to the next
                for (N = 0; N < W; N += W / nubs)
                   for (Y = 0; Y < 4; Y++)
-                     for (X = 0; X < 4; X++)
+                     for (X = 0; X < C; X++)
                      {
-                        int S = N * 4 + X + (parkvertical ? 0 : 2);
+                        int S = N * K + X + (parkvertical ? 0 : floorslices + 1);
                         double z =
-                           y0 - dy * 1.5 / 4 + (helix + 1) * mazestep + Y * mazestep / 4 + dy * X / 4 +
-                           (parkvertical ? mazestep / 8 : dy / 2 - mazestep * 3 / 8);
+                           y0 - dy * 1.5 / 4 + (helix + 1) * mazestep + Y * mazestep / 4 + dy * (slicepos (S) - N * 4 - (parkvertical ? 0 : 2)) / 4 +
+                           (parkvertical ? mazestep / 8 : dy * 2 / 4 - mazestep * 3 / 8);
+                        S %= W * K;     // Across the join from the last cell
                         double x = s[S].x[1];
                         double y = s[S].y[1];
-                        if (parkvertical ? Y == 1 || Y == 2 : X == 1 || X == 2)
+                        if (parkvertical ? Y == 1 || Y == 2 : X > 0 && X < C - 1)
                         {       // ridge height instead or surface
                            x = (s[S].x[1] * (mazethickness - parkthickness) + s[S].x[2] * parkthickness) / mazethickness;
                            y = (s[S].y[1] * (mazethickness - parkthickness) + s[S].y[2] * parkthickness) / mazethickness;
                         } else if (parkvertical)
                            z -= nubskew;
-                        printf ("[%lld,%lld,%lld],", scaled (s[S].x[0]), scaled (s[S].y[0]), scaled (z));
-                        printf ("[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
+                        mesh_point (&mesh, scaled (s[S].x[0]), scaled (s[S].y[0]), scaled (z));
+                        mesh_point (&mesh, scaled (x), scaled (y), scaled (z));
                      }
-               printf ("],faces=[");
                for (N = 0; N < nubs; N++)
                {
-                  int P = N * 32;
+                  int P = N * C * 8;
                   inline void add (int a, int b, int c, int d)
                   {
-                     printf ("[%d,%d,%d],[%d,%d,%d],", P + a, P + b, P + c, P + a, P + c, P + d);
+                     int f[6] = { P + a, P + b, P + c, P + a, P + c, P + d };
+                     mesh_face (&mesh, 3, f);
+                     mesh_face (&mesh, 3, f + 3);
+                  }
+                  inline int i (int X, int Y, int front)
+                  {             // Point in the grid, back and front
+                     return (Y * C + X) * 2 + front;
                   }
-                  for (X = 0; X < 6; X += 2)
+                  for (X = 0; X < C - 1; X++)
                   {
-                     add (X + 0, X + 1, X + 3, X + 2);
-                     for (Y = 0; Y < 24; Y += 8)
+                     add (i (X, 0, 0), i (X, 0, 1), i (X + 1, 0, 1), i (X + 1, 0, 0));
+                     for (Y = 0; Y < 3; Y++)
                      {
-                        add (X + 0 + Y, X + 2 + Y, X + 10 + Y, X + 8 + Y);
-                        add (X + 1 + Y, X + 9 + Y, X + 11 + Y, X + 3 + Y);
+                        add (i (X, Y, 0), i (X + 1, Y, 0), i (X + 1, Y + 1, 0), i (X, Y + 1, 0));
+                        add (i (X, Y, 1), i (X, Y + 1, 1), i (X + 1, Y + 1, 1), i (X + 1, Y, 1));
                      }
-                     add (X + 25, X + 24, X + 26, X + 27);
+                     add (i (X, 3, 1), i (X, 3, 0), i (X + 1, 3, 0), i (X + 1, 3, 1));
                   }
-                  for (Y = 0; Y < 24; Y += 8)
+                  for (Y = 0; Y < 3; Y++)
                   {
-                     add (Y + 0, Y + 8, Y + 9, Y + 1);
-                     add (Y + 6, Y + 7, Y + 15, Y + 14);
+                     add (i (0, Y, 0), i (0, Y + 1, 0), i (0, Y + 1, 1), i (0, Y, 1));
+                     add (i (C - 1, Y, 0), i (C - 1, Y, 1), i (C - 1, Y + 1, 1), i (C - 1, Y + 1, 0));
                   }
                }
-               printf ("],convexity=10);\n");
+               char name[50];
+               snprintf (name, sizeof (name), "Part %d park ridge %s", part, inside ? "inside" : "outside");
+               st = stat_begin ("emit", part, inside);
+               mesh_emit (&mesh, ",", name);
+               stat_end (st);
+               if (png || glb)
+                  scene_mesh (&scene, &mesh, part, scenex, sceney, scenea, 1, inside && mirrorinside);
+               count_points += mesh.points;
+               count_faces += mesh.faces;
+               mesh_free (&mesh);
+               printf (",convexity=10);\n");
             }
          }
       }
+      if (platexy)
+      {                         // Placed for plating
+         x = platex - (outersides & 1 ? r3 : r2);
+         y = platey - (outersides & 1 ? r3 : r2);
+      }
       printf ("translate([%lld,%lld,0])\n", scaled (x + (outersides & 1 ? r3 : r2)), scaled (y + (outersides & 1 ? r3 : r2)));
       if (outersides)
          printf ("rotate([0,0,%f])", (double) 180 / outersides + (part + 1 == parts ? 180 : 0));
+      scenex = x + (outersides & 1 ? r3 : r2);
+      sceney = y + (outersides & 1 ? r3 : r2);
+      scenea = (outersides ? (double) 180 / outersides + (part + 1 == parts ? 180 : 0) : 0);
+      if (png || glb)
+      {                         // Base and plain walls, the mazes and nubs are added as made
+         double R = r2,
+            h = (part == parts ? height : baseheight),
+            hole = r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0);
+         int sides = roundn;
+         if (part + 1 >= parts)
+         {                      // Outer shape
+            sides = (outersides ? : roundn);
+            R = (r2 - outerround) / cos ((double) M_PI / sides) + outerround;
+         }
+         double a = scenea + (part + 1 == parts && part < parts ? 180 : 0);     // Mirrored
+         scene_ring (&scene, part, scenex, sceney, a, 0, R, sides, 0, basethickness);
+         scene_ring (&scene, part, scenex, sceney, a, hole, R, sides, basethickness, h);
+         if (!mazeinside && !mazeoutside && part < parts)
+            scene_ring (&scene, part, scenex, sceney, 0, r0, r1, roundn, basethickness, height);
+      }
       printf ("{\n");
       void mark (void)
       {                         // Marking position 0
@@ -1423,33 +5697,34 @@ main (int argc, const char *argv[])
       if (!mazeinside && !mazeoutside && part < parts)
       {
          printf ("difference(){\n");
-         printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness / 2 - clearance), scaled (r1), scaled (height - basethickness / 2 + clearance), W * 4, scaled (basethickness), scaled (r0), scaled (height), W * 4);       // Non maze
+         printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness / 2 - clearance), scaled (r1), scaled (height - basethickness / 2 + clearance), segments (r1, W * mazeslices), scaled (basethickness), scaled (r0), scaled (height), segments (r0, W * mazeslices));     // Non maze
          printf ("}\n");
       }
       // Base
+      double outercos = (deterministic ? trig_cos (0.5 / (outersides ? : roundn)) : cos ((double) M_PI / (outersides ? : roundn)));
       printf ("difference(){\n");
       if (part == parts)
-         printf ("outer(%lld,%lld);\n", scaled (height), scaled ((r2 - outerround) / cos ((double) M_PI / (outersides ? : 100))));
+         printf ("outer(%lld,%lld);\n", scaled (height), scaled ((r2 - outerround) / outercos));
       else if (part + 1 >= parts)
          printf ("mirror([1,0,0])outer(%lld,%lld);\n", scaled (baseheight),
-                 scaled ((r2 - outerround) / cos ((double) M_PI / (outersides ? : 100))));
+                 scaled ((r2 - outerround) / outercos));
       else
          printf ("hull(){cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);}\n",
-                 scaled (r2 - mazethickness), scaled (baseheight), W * 4, scaled (mazemargin), scaled (r2),
-                 scaled (baseheight - mazemargin), W * 4);
-      printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0)), scaled (height), W * 4);        // Hole
+                 scaled (r2 - mazethickness), scaled (baseheight), W * mazeslices, scaled (mazemargin), scaled (r2),
+                 scaled (baseheight - mazemargin), W * mazeslices);
+      printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0)), scaled (height), W * mazeslices);       // Hole
       printf ("}\n");
       printf ("}\n");
       // Cut outs
       if (gripdepth && part + 1 < parts)
          printf
-            ("rotate([0,0,%f])translate([0,0,%lld])rotate_extrude(convexity=10,$fn=%d)translate([%lld,0,0])circle(r=%lld,$fn=9);\n",
-             (double) 360 / W / 4 / 2, scaled (mazemargin + (baseheight - mazemargin) / 2), W * 4, scaled (r2 + gripdepth),
-             scaled (gripdepth * 2));
+            ("rotate([0,0,%f])translate([0,0,%lld])rotate_extrude(convexity=10,$fn=%d)translate([%lld,0,0])circle(r=%lld,$fn=%d);\n",
+             (double) 360 / W / mazeslices / 2, scaled (mazemargin + (baseheight - mazemargin) / 2), W * mazeslices, scaled (r2 + gripdepth),
+             scaled (gripdepth * 2), segments (gripdepth * 2, 9));
       else if (gripdepth && part + 1 == parts)
-         printf ("translate([0,0,%lld])rotate_extrude(convexity=10,$fn=%d)translate([%lld,0,0])circle(r=%lld,$fn=9);\n",
-                 scaled (outerround + (baseheight - outerround) / 2), outersides ? : 100, scaled (r3 + gripdepth),
-                 scaled (gripdepth * 2));
+         printf ("translate([0,0,%lld])rotate_extrude(convexity=10,$fn=%d)translate([%lld,0,0])circle(r=%lld,$fn=%d);\n",
+                 scaled (outerround + (baseheight - outerround) / 2), outersides ? : roundn, scaled (r3 + gripdepth),
+                 scaled (gripdepth * 2), segments (gripdepth * 2, 9));
       if (basewide && nextoutside && part + 1 < parts)  // Connect endpoints over base
       {
          int W = ((int) ((r2 - mazethickness) * 2 * M_PI / mazestep)) / nubs * nubs;
@@ -1483,7 +5758,7 @@ main (int argc, const char *argv[])
       void textside (int outset)
       {
          double a = 90 + (double) 180 / outersides;
-         double h = r3 * sin (M_PI / outersides) * textsidescale;
+         double h = r3 * (deterministic ? trig_sin (0.5 / outersides) : sin (M_PI / outersides)) * textsidescale;
          char *p = strdup (textsides);
          char *orig = p;
          while (p)
@@ -1505,8 +5780,23 @@ main (int argc, const char *argv[])
       if (textsides && part == parts && outersides && !textoutset)
          textside (0);
       if (logo && part == parts)
-         printf ("translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)aa(%lld,white=true);\n",
-                 scaled (basethickness - logodepth), scaled (logodepth * 2), scaled (r0 * 1.8));
+      {
+         printf ("translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)aa(%lld", scaled (basethickness - logodepth),
+                 scaled (logodepth * 2), scaled (r0 * 1.8));
+         if (!textnative)
+            printf (",white=true");
+         if (tolerance > 0 && !textnative)
+            printf (",$fn=%d", segments (r0 * 0.9, 100));
+         printf (");\n");
+      }
+#ifdef HAVE_FREETYPE
+      else if (textinside && textnative)
+      {
+         printf ("translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)scale(%lld)", scaled (basethickness - logodepth),
+                 scaled (logodepth * 2), scaled (1));
+         text_polygon (textinside, textfontend, r0);
+      }
+#endif
       else if (textinside)
          printf
             ("translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)text(\"%s\",font=\"%s\",size=%lld,halign=\"center\",valign=\"center\");\n",
@@ -1517,13 +5807,21 @@ main (int argc, const char *argv[])
       if (textsides && part == parts && outersides && textoutset)
          textside (1);
       if (coresolid && part == 1)
-         printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (r0 + clearance + (!mazeinside && part < parts ? clearance : 0)), scaled (height - basethickness), W * 4);    // Solid core
+         printf ("translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (r0 + clearance + (!mazeinside && part < parts ? clearance : 0)), scaled (height - basethickness), segments (r0 + clearance, W * mazeslices));  // Solid core
       if ((mazeoutside && !flip && part == parts) || (!mazeoutside && part + 1 == parts))
          entrya = 0;            // Align for lid alignment
       else if (part < parts && !basewide)
       {                         // We can position randomly
          int v;
-         v = random_int (360);
+         if (mazeinf)
+         {
+            const char *e = angle_load (mazeinf, part, &v);
+            if (e)
+               fatal ("%s: %s", mazein, e);
+         } else
+            v = random_int (360);
+         if (mazeoutf)
+            angle_save (mazeoutf, part, v);
          entrya = v;
       }
       // Nubs
@@ -1531,6 +5829,7 @@ main (int argc, const char *argv[])
       {
          double ri = r + (inside ? -mazethickness : mazethickness);
          int W = ((int) ((ri + (inside ? -clearance : clearance)) * 2 * M_PI / mazestep)) / nubs * nubs;
+         const int K = floorslices + 3; // Columns, as the maze across the groove
          double da = (double) 2 * M_PI / W / 4; // x angle per 1/4 maze step
          double dz = mazestep / 4 - nubzclearance;
          double my = mazestep * da * 4 * helix / (r * 2 * M_PI);
@@ -1540,43 +5839,106 @@ main (int argc, const char *argv[])
             my = -my;           // This is nub outside which is for inside maze
          double a = -da * 1.5;  // Centre A
          double z = height - mazestep / 2 - (parkvertical ? 0 : mazestep / 8) - dz * 1.5 - my * 1.5;    // Centre Z
-         printf ("rotate([0,0,%f])for(a=[0:%f:359])rotate([0,0,a])polyhedron(points=[", entrya, (double) 360 / nubs);
+         if (preview)
+            printf ("rotate([0,0,%f])polyhedron(", entrya);
+         else
+            printf ("rotate([0,0,%f])for(a=[0:%f:359])rotate([0,0,a])polyhedron(", entrya, (double) 360 / nubs);
+         mesh_t mesh = { 0 };
          r += (inside ? nubrclearance : -nubrclearance);        // Extra gap
          ri += (inside ? nubrclearance : -nubrclearance);       // Extra gap
+         inline int raised (int Z, int X)
+         {
+            return X > 0 && X < K - 1 && (Z == 1 || Z == 2);
+         }
+         double nubsin (int X)
+         {
+            return deterministic ? trig_sin ((inside ? -1 : 1) * (slicepos (X) - 1.5) / (W * 4)) : sin (a + da * slicepos (X));
+         }
+         double nubcos (int X)
+         {
+            return deterministic ? trig_cos ((inside ? -1 : 1) * (slicepos (X) - 1.5) / (W * 4)) : cos (a + da * slicepos (X));
+         }
          for (Z = 0; Z < 4; Z++)
-            for (X = 0; X < 4; X++)
-               printf ("[%lld,%lld,%lld],", scaled (((X == 1 || X == 2) && (Z == 1 || Z == 2) ? ri : r) * sin (a + da * X)),
-                       scaled (((X == 1 || X == 2)
-                                && (Z == 1 || Z == 2) ? ri : r) * cos (a + da * X)), scaled (z + Z * dz + X * my + (Z == 1
-                                                                                                                    || Z ==
-                                                                                                                    2 ? nubskew :
-                                                                                                                    0)));
+            for (X = 0; X < K; X++)
+               mesh_point (&mesh, scaled ((raised (Z, X) ? ri : r) * nubsin (X)), scaled ((raised (Z, X) ? ri : r) * nubcos (X)),
+                           scaled (z + Z * dz + slicepos (X) * my + (Z == 1 || Z == 2 ? nubskew : 0)));
          r += (inside ? clearance - nubrclearance : -clearance + nubrclearance);        // Back in to wall
          for (Z = 0; Z < 4; Z++)
-            for (X = 0; X < 4; X++)
-               printf ("[%lld,%lld,%lld],", scaled (r * sin (a + da * X)), scaled (r * cos (a + da * X)),
-                       scaled (z + Z * dz + X * my + (Z == 1 || Z == 2 ? nubskew : 0)));
-         printf ("],faces=[");
+            for (X = 0; X < K; X++)
+               mesh_point (&mesh, scaled (r * nubsin (X)), scaled (r * nubcos (X)),
+                           scaled (z + Z * dz + slicepos (X) * my + (Z == 1 || Z == 2 ? nubskew : 0)));
+         void add (int a, int b, int c, int d, int e, int f)
+         {                      // Two triangles
+            int t[6] = { a, b, c, d, e, f };
+            mesh_face (&mesh, 3, t);
+            mesh_face (&mesh, 3, t + 3);
+         }
+         int B = K * 4,
+            E = K - 1;          // Back points, right column
          for (Z = 0; Z < 3; Z++)
-            for (X = 0; X < 3; X++)
-               printf ("[%d,%d,%d],[%d,%d,%d],", Z * 4 + X + 20, Z * 4 + X + 21, Z * 4 + X + 17, Z * 4 + X + 20, Z * 4 + X + 17,
-                       Z * 4 + X + 16);
+            for (X = 0; X < E; X++)
+               add (B + (Z + 1) * K + X, B + (Z + 1) * K + X + 1, B + Z * K + X + 1, B + (Z + 1) * K + X, B + Z * K + X + 1, B + Z * K + X);
          for (Z = 0; Z < 3; Z++)
-            printf ("[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],", Z * 4 + 4, Z * 4 + 20, Z * 4 + 16, Z * 4 + 4, Z * 4 + 16,
-                    Z * 4 + 0, Z * 4 + 23, Z * 4 + 7, Z * 4 + 3, Z * 4 + 23, Z * 4 + 3, Z * 4 + 19);
-         for (X = 0; X < 3; X++)
-            printf ("[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],", X + 28, X + 12, X + 13, X + 28, X + 13, X + 29, X + 0, X + 16,
-                    X + 17, X + 0, X + 17, X + 1);
-         printf ("[0,1,5],[0,5,4],[4,5,9],[4,9,8],[8,9,12],[9,13,12],");
-         printf ("[1,2,6],[1,6,5],[5,6,10],[5,10,9],[9,10,14],[9,14,13],");
-         printf ("[2,3,6],[3,7,6],[6,7,11],[6,11,10],[10,11,15],[10,15,14],");
-         printf ("]);\n");
+         {
+            add ((Z + 1) * K, B + (Z + 1) * K, B + Z * K, (Z + 1) * K, B + Z * K, Z * K);
+            add (B + (Z + 1) * K + E, (Z + 1) * K + E, Z * K + E, B + (Z + 1) * K + E, Z * K + E, B + Z * K + E);
+         }
+         for (X = 0; X < E; X++)
+         {
+            add (B + K * 3 + X, K * 3 + X, K * 3 + X + 1, B + K * 3 + X, K * 3 + X + 1, B + K * 3 + X + 1);
+            add (X, B + X, B + X + 1, X, B + X + 1, X + 1);
+         }
+         for (X = 0; X < E; X++)
+            for (Z = 0; Z < 3; Z++)
+            {                   // Front, split corners through the one raised point
+               int q = Z * K + X;
+               if (!raised (Z, X) && !raised (Z + 1, X + 1) && raised (Z, X + 1) != raised (Z + 1, X))
+                  add (q, q + 1, q + K, q + 1, q + K + 1, q + K);
+               else
+                  add (q, q + 1, q + K + 1, q, q + K + 1, q + K);
+            }
+         if (preview)
+         {                      // All nubs in one polyhedron, saving a union
+            int points = mesh.points,
+               faces = mesh.faces;
+            for (N = 1; N < nubs; N++)
+            {
+               double na = 2 * M_PI * N / nubs,
+                  sa = sin (na),
+                  ca = cos (na);
+               if (deterministic)
+                  trig_sincos ((double) N / nubs, &sa, &ca);
+               for (int i = 0; i < points; i++)
+                  mesh_point (&mesh, llround (mesh.point[i][0] * ca - mesh.point[i][1] * sa),
+                              llround (mesh.point[i][0] * sa + mesh.point[i][1] * ca), mesh.point[i][2]);
+               for (int f = 0; f < faces; f++)
+               {
+                  int n = mesh.face[f + 1] - mesh.face[f],
+                     v[n];
+                  for (int i = 0; i < n; i++)
+                     v[i] = mesh.index[mesh.face[f] + i] + N * points;
+                  mesh_face (&mesh, n, v);
+               }
+            }
+         }
+         char name[50];
+         snprintf (name, sizeof (name), "Part %d nub %s", part, inside ? "inside" : "outside");
+         int st = stat_begin ("emit", part, -1);
+         mesh_emit (&mesh, ",", name);
+         stat_end (st);
+         if (png || glb)
+            scene_mesh (&scene, &mesh, part, scenex, sceney, scenea + entrya, preview ? 1 : nubs, 0);
+         count_points += mesh.points * (preview ? 1 : nubs);    // Repeated for each nub
+         count_faces += mesh.faces * (preview ? 1 : nubs);
+         mesh_free (&mesh);
+         printf (");\n");
       }
       if (!mazeinside && part > 1)
          addnub (r0, 1);
       if (!mazeoutside && part < parts)
          addnub (r1, 0);
       printf ("}\n");
+      stat_end (st);
       x += (outersides & 1 ? r3 : r2) + r2 + 5;
       if (++n >= sq)
       {
@@ -1586,12 +5948,117 @@ main (int argc, const char *argv[])
       }
    }
 
+   void pngout (void)
+   {                            // Write the picture
+      if (png)
+      {
+         const char *e = scene_png (&scene, png, pngw, pngh, threads);
+         if (e)
+            fatal ("%s: %s", png, e);
+      }
+      free (scene.tri);
+      free (scene.part);
+   }
+#ifndef _WIN32
+   if (renderprefix)
+   {                            // Each part to its own file, then render
+      fclose (stdout);
+      render_job_t jobs[parts];
+      int count = 0;
+      for (int p = (part ? : 1); p <= (part ? : parts); p++)
+      {
+         render_job_t *j = &jobs[count++];
+         memset (j, 0, sizeof (*j));
+         j->part = p;
+         render_names (j, renderprefix, "part", p);
+         if (!(stdout = fopen (j->scad, "w")))
+            fatal ("Cannot write %s", j->scad);
+         if (stat_on)
+            stdout = count_open (stdout);
+         fwrite (renderheader, 1, renderheaderlen, stdout);
+         long long p0 = count_points,
+            f0 = count_faces;
+         x = y = 0;
+         printf ("scale(" SCALEI "){\n");
+         int t0 = scene.tris;
+         box (p);
+         scene_place (&scene, t0);
+         printf ("}\n");
+         fclose (stdout);
+         j->points = count_points - p0;
+         j->faces = count_faces - f0;
+         j->cost = rendermodel[0] + rendermodel[1] * j->points + rendermodel[2] * j->faces;
+      }
+      free (renderheader);
+      if (mesh_failures)
+         fatal ("Mesh check failed, not rendering");
+      pngout ();
+      statsout ();
+      return render_parts (jobs, count, renderjobs, renderlog);
+   }
+#endif
    printf ("scale(" SCALEI "){\n");
-   if (part)
+   if (part && platexy)
+   {                            // Plating - all parts are made, so the mazes are those of the whole box, and one kept
+      FILE *keep = stdout;
+#ifdef _WIN32
+      FILE *null = fopen ("NUL", "w");
+#else
+      FILE *null = fopen ("/dev/null", "w");
+#endif
+      if (!null)
+         fatal ("Cannot open null output");
+      int want = part;
+      for (part = 1; part <= parts; part++)
+      {
+         stdout = (part == want ? keep : null);
+         box (part);
+      }
+      stdout = keep;
+      fclose (null);
+   } else if (part)
       box (part);
    else
       for (part = 1; part <= parts; part++)
          box (part);
    printf ("}\n");
-   return 0;
+   if (mazeoutf)
+      fclose (mazeoutf);
+   if (mazeinf)
+      fclose (mazeinf);
+   if (svg || glb)
+   {
+      fclose (stdout);
+      stdout = drawout;
+   }
+   if (svg)
+   {
+      svg_write (stdout, svgmaze, svgmazes, svgsolution);
+      for (int i = 0; i < svgmazes; i++)
+         free (svgmaze[i].m.maze);
+      free (svgmaze);
+   }
+   if (glb)
+   {
+      const char *e = glb_write (stdout, &scene);
+      if (e)
+         fatal ("%s", e);
+   }
+   if (encoding)
+   {                            // Closes any counter over it too, back to the stream underneath for what follows
+      int e = fclose (stdout);
+      stdout = plain;
+      if (e)
+         fatal ("Output failed");
+   }
+   if (piped)
+   {                            // Wait for the writer thread to finish, closing any counter over it too
+      FILE *top = stdout;
+      stdout = pipeout;
+      if (fclose (top))
+         fatal ("Output failed");
+   }
+   pngout ();
+   statsout ();
+   return mesh_failures ? 1 : 0;
 }